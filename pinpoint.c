@@ -28,6 +28,8 @@
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <glib/gstdio.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
 
 #include "pinpoint.h"
 
@@ -35,11 +37,10 @@
 #include <clutter-gst/clutter-gst.h>
 #endif
 
-/* Probably time to create a PinPointPresentation type */
-
-GList *pp_slides      = NULL; /* list of slide text */
-GList *pp_slidep      = NULL; /* current slide */
-GFile *pp_basedir     = NULL; /* basedir to resolve relative paths against */
+GPtrArray *pp_slides   = NULL; /* the slides, in presentation order */
+gint       pp_slide_no = -1;   /* index of the current slide */
+GFile     *pp_basedir  = NULL; /* basedir to resolve relative paths against */
+static char *pp_source_dir = NULL; /* the same, for point->bg_file */
 
 typedef struct
 {
@@ -104,9 +105,7 @@ static PinPointPoint pin_default_point = {
   .data = NULL,
 };
 
-static PinPointPoint default_point;
-
-PinPointPoint *point_defaults = &default_point;
+PinPointPoint *point_defaults = &pin_default_point;
 
 char     *pp_output_filename = NULL;
 gboolean  pp_fullscreen      = FALSE;
@@ -114,7 +113,16 @@ gboolean  pp_maximized       = FALSE;
 gboolean  pp_speakermode     = FALSE;
 gboolean  pp_rehearse        = FALSE;
 gboolean  pp_ignore_comments = FALSE;
+gboolean  pp_compile         = FALSE;
 char     *pp_camera_device   = NULL;
+gint      pp_texture_budget  = 0;   /* MB, 0 for no limit */
+gint      pp_texture_window  = 3;
+gboolean  pp_rgb565          = FALSE;
+gint      pp_pdf_jobs        = 0;   /* 0 for one per core */
+gint      pp_pdf_dpi         = 0;   /* 0 keeps the images as they are */
+gint      pp_pdf_jpeg_quality = 85;
+gboolean  pp_benchmark_frames = FALSE;
+static gint pp_benchmark_slides = 0;
 
 static GOptionEntry entries[] =
 {
@@ -134,8 +142,38 @@ static GOptionEntry entries[] =
     { "output", 'o', 0, G_OPTION_ARG_STRING, &pp_output_filename,
       "Output presentation to FILE\n"
 "                                         (formats supported: pdf)", "FILE" },
+    { "jobs", 'j', 0, G_OPTION_ARG_INT, &pp_pdf_jobs,
+      "Threads drawing the pdf (default: one per\n"
+"                                         core)", "N" },
+    { "pdf-dpi", 0, 0, G_OPTION_ARG_INT, &pp_pdf_dpi,
+      "Resample larger images in the pdf to N dots\n"
+"                                         per inch as shown on the page", "N" },
+    { "pdf-jpeg-quality", 0, 0, G_OPTION_ARG_INT, &pp_pdf_jpeg_quality,
+      "Quality of the jpeg images resampled for\n"
+"                                         --pdf-dpi (default: 85)", "Q" },
+    { "compile", 0, 0, G_OPTION_ARG_NONE, &pp_compile,
+      "Write a precompiled FILE.pinc next to the\n"
+"                                         presentation, used instead of parsing\n"
+"                                         it for as long as it is unchanged", NULL },
     { "camera", 'c', 0, G_OPTION_ARG_STRING, &pp_camera_device,
       "Device to use for [camera] background", "DEVICE" },
+    { "texture-budget", 0, 0, G_OPTION_ARG_INT, &pp_texture_budget,
+      "Keep at most MB of background images loaded,\n"
+"                                         only around the current slide", "MB" },
+    { "texture-window", 0, 0, G_OPTION_ARG_INT, &pp_texture_window,
+      "Slides ahead to preload with --texture-budget\n"
+"                                         (default: 3)", "N" },
+    { "rgb565", 0, 0, G_OPTION_ARG_NONE, &pp_rgb565,
+      "Keep opaque backgrounds as 16 bit textures,\n"
+"                                         halving their memory", NULL },
+    { "benchmark-parser", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_INT,
+      &pp_benchmark_slides,
+      "Report parser throughput on a generated deck of N slides", "N" },
+    { "benchmark-frames", 0, 0, G_OPTION_ARG_NONE, &pp_benchmark_frames,
+      "Step through the presentation with all the\n"
+"                                         slides on the stage, then only those\n"
+"                                         around the current one, and report\n"
+"                                         the frame times", NULL },
     { NULL }
 };
 
@@ -144,13 +182,31 @@ PinPointRenderer *pp_clutter_renderer (void);
 PinPointRenderer *pp_cairo_renderer   (void);
 #endif
 static char * pp_serialize (void);
+static gboolean pp_pinc_load  (PinPointRenderer *renderer,
+                               const char       *pinfile,
+                               GMappedFile      *source);
+static gboolean pp_pinc_write (const char       *pinfile,
+                               GMappedFile      *source);
+static void     pp_parse_clear (PinPointRenderer *renderer);
+static void     pp_parse_wait  (void);
+static guint64  pp_source_hash (const char       *src,
+                                gsize             len);
+
+/* returns NULL when slide_no is out of range */
+PinPointPoint *
+pp_slide_nth (gint slide_no)
+{
+  if (!pp_slides || slide_no < 0 || slide_no >= (gint) pp_slides->len)
+    return NULL;
+  return g_ptr_array_index (pp_slides, slide_no);
+}
 
 void pp_rehearse_init (void)
 {
-  GList *iter;
-  for (iter = pp_slides; iter; iter=iter->next)
+  PinPointPoint *point;
+  gint i;
+  for (i = 0; (point = pp_slide_nth (i)); i++)
     {
-      PinPointPoint *point = iter->data;
       point->new_duration = 0.0;
     }
 }
@@ -158,6 +214,10 @@ void pp_rehearse_init (void)
 
 static char *pinfile = NULL;
 
+/* hash of what pp_rehearse_save () wrote, the slides shown have that content
+ * already and the reload it triggers can be skipped. 0 for none */
+static guint64 pp_saved_hash = 0;
+
 static void pp_rehearse_save (void)
 {
   GError *error = NULL;
@@ -169,6 +229,7 @@ static void pp_rehearse_save (void)
   else
     {
       printf ("saved to %s\n", pinfile);
+      pp_saved_hash = pp_source_hash (content, strlen (content));
     }
   g_free (content);
 }
@@ -176,25 +237,92 @@ static void pp_rehearse_save (void)
 
 void pp_rehearse_done (void)
 {
-  GList *iter;
-  for (iter = pp_slides; iter; iter=iter->next)
+  PinPointPoint *point;
+  gint i;
+  pp_stream_finish ();
+  for (i = 0; (point = pp_slide_nth (i)); i++)
     {
-      PinPointPoint *point = iter->data;
       point->duration = point->new_duration;
     }
   pp_rehearse_save ();
 }
 
+/* a renderer that makes nothing, to time or compile the parser alone */
+static gboolean
+pp_null_make_point (PinPointRenderer *renderer,
+                    PinPointPoint    *point)
+{
+  return TRUE;
+}
+
+static void
+pp_benchmark_parser (gint n_slides)
+{
+  PinPointRenderer renderer = { .make_point = pp_null_make_point };
+  GString *deck = g_string_new ("#!/usr/bin/env pinpoint\n"
+                                "[font=Sans 50px][text-color=white]\n"
+                                "[shading-opacity=0.5][fit]\n");
+  gint64   start, elapsed;
+  gint     i, runs = 0;
+
+  /* a mix of the slide kinds found in real decks */
+  for (i = 0; i < n_slides; i++)
+    switch (i % 4)
+      {
+        case 0:
+          g_string_append_printf (deck,
+            "-- [bg%d.jpg][fill][bottom-left][transition=text-slide-up]\n"
+            "Slide %d with <b>markup</b>\n"
+            "and a second line\n"
+            "# a note for slide %d\n\n", i, i, i);
+          break;
+        case 1:
+          g_string_append (deck,
+            "-- [#336699][text-align=center][duration=12.5]\n"
+            "A slide \\[with escapes\\]\n\n");
+          break;
+        case 2:
+          g_string_append (deck, "--\nPlain text\n");
+          break;
+        case 3:
+          g_string_append_printf (deck,
+            "-- [video%d.ogv][no-markup][shading-color=#000000]\n\n"
+            "Longer text, the sort of thing that gets pasted into a slide "
+            "and then goes on for a while without any settings in it\n"
+            "# notes\n# more notes\n", i);
+          break;
+      }
+
+  /* parse from scratch each run, not reusing the previous one */
+  start = g_get_monotonic_time ();
+  do
+    {
+      pp_parse_clear (&renderer);
+      pp_parse_slides (&renderer, deck->str, deck->len);
+      runs++;
+      elapsed = g_get_monotonic_time () - start;
+    }
+  while (runs < 3 || elapsed < G_USEC_PER_SEC);
+
+  printf ("parsed %u slides (%.2f MB) %d times: %.1f MB/s, %.2f ms per parse\n",
+          pp_slides->len, deck->len / 1e6, runs,
+          deck->len * (gdouble) runs / elapsed,
+          elapsed / 1000.0 / runs);
+
+  pp_parse_clear (&renderer);
+  g_string_free (deck, TRUE);
+}
+
 int
 main (int    argc,
       char **argv)
 {
   PinPointRenderer *renderer;
   GOptionContext   *context;
-  GError *error = NULL;
-  char   *text  = NULL;
+  GError      *error  = NULL;
+  GMappedFile *mapped = NULL;
+  const char  *text   = NULL;
 
-  memcpy (&default_point, &pin_default_point, sizeof (default_point));
   renderer = pp_clutter_renderer ();
 
   context = g_option_context_new ("- Presentations made easy");
@@ -207,22 +335,38 @@ main (int    argc,
       return EXIT_FAILURE;
     }
 
+  if (pp_benchmark_slides > 0)
+    {
+      pp_benchmark_parser (pp_benchmark_slides);
+      return EXIT_SUCCESS;
+    }
+
   pinfile = argv[1];
 
   if (!pinfile)
     {
       g_print ("usage: %s [options] <presentation>\n", argv[0]);
-      text = g_strdup ("[no-markup][transition=sheet][red]\n"
-                       "--\n"
-                       "usage: pinpoint [options] <presentation.txt>\n");
+      text = "[no-markup][transition=sheet][red]\n"
+             "--\n"
+             "usage: pinpoint [options] <presentation.txt>\n";
     }
   else
     {
-      if (!g_file_get_contents (pinfile, &text, NULL, NULL))
+      mapped = g_mapped_file_new (pinfile, FALSE, NULL);
+      if (!mapped)
         {
           g_print ("failed to load presentation from %s\n", pinfile);
           return -1;
         }
+      pp_source_dir = g_path_get_dirname (pinfile);
+
+      if (pp_compile)
+        {
+          gboolean ok = pp_pinc_write (pinfile, mapped);
+
+          g_mapped_file_unref (mapped);
+          return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
     }
 
 #ifdef USE_CLUTTER_GST
@@ -240,7 +384,7 @@ main (int    argc,
 #ifdef HAVE_PDF
       renderer = pp_cairo_renderer ();
       /* makes more sense to default to a white "stage" colour in PDFs*/
-      default_point.stage_color = "white";
+      pin_default_point.stage_color = "white";
 #else
       g_warning ("Pinpoint was built without PDF support");
       return EXIT_FAILURE;
@@ -260,8 +404,16 @@ main (int    argc,
     }
 
   renderer->init (renderer, pinfile);
-  pp_parse_slides (renderer, text);
-  g_free (text);
+  if (mapped)
+    {
+      /* a compiled presentation is not parsed at all, big ones that are
+       * not get the rest of their slides parsed from idle */
+      if (!pp_pinc_load (renderer, pinfile, mapped))
+        pp_stream_slides (renderer, mapped);
+      g_mapped_file_unref (mapped);
+    }
+  else
+    pp_parse_slides (renderer, text, strlen (text));
 
   if (pp_rehearse)
     {
@@ -269,15 +421,15 @@ main (int    argc,
       printf ("Running in rehearsal mode, press ctrl+C to abort without saving timings back to %s\n", pinfile);
     }
   renderer->run (renderer);
+  /* a reload still being parsed reads the slides about to go away */
+  pp_parse_wait ();
   renderer->finalize (renderer);
-  if (renderer->source)
-    g_free (renderer->source);
 #if 0
   if (pp_rehearse)
     pp_rehearse_save ();
 #endif
 
-  g_list_free (pp_slides);
+  pp_parse_clear (NULL);
 
   return 0;
 }
@@ -459,13 +611,172 @@ pp_get_shading_position_size (float stage_width,
   *shading_height = text_height * text_scale + padding * 2;
 }
 
-void     pp_parse_slides  (PinPointRenderer *renderer,
-                           const char       *slide_src);
-
 /*
  * Parsing
+ *
+ * The source (usually a mapped file) is tokenized in place: settings, slide
+ * text and notes are slices of it, only what ends up in a point gets copied.
+ */
+
+/* Everything a parse allocates, the points as well as their text, notes and
+ * settings, belongs to an arena that is freed in one go once a reload has
+ * replaced the points. Setting values (fonts, colors, paths..) are stored
+ * only once per arena.
+ */
+#define PP_ARENA_BLOCK 64
+
+typedef struct
+{
+  GStringChunk *strings;
+  GSList       *blocks;  /* of PP_ARENA_BLOCK points, the newest first */
+  guint         n_used;  /* points handed out from the newest block */
+  GMappedFile  *pinc;    /* the strings of a loaded .pinc point into it */
+  GString      *scratch; /* for pp_arena_intern () */
+} PPArena;
+
+static PPArena *
+pp_arena_new (gsize source_length)
+{
+  PPArena *arena = g_new0 (PPArena, 1);
+
+  /* text and settings take up less room than the source they came from */
+  arena->strings = g_string_chunk_new (MAX (source_length, 1024));
+  arena->n_used = PP_ARENA_BLOCK;
+  arena->scratch = g_string_sized_new (128);
+  return arena;
+}
+
+static void
+pp_arena_free (PPArena *arena)
+{
+  if (!arena)
+    return;
+  g_string_chunk_free (arena->strings);
+  g_slist_free_full (arena->blocks, g_free);
+  if (arena->pinc)
+    g_mapped_file_unref (arena->pinc);
+  g_string_free (arena->scratch, TRUE);
+  g_free (arena);
+}
+
+static PinPointPoint *
+pp_arena_new_point (PPArena *arena)
+{
+  if (arena->n_used == PP_ARENA_BLOCK)
+    {
+      arena->blocks = g_slist_prepend (arena->blocks,
+                                       g_new0 (PinPointPoint, PP_ARENA_BLOCK));
+      arena->n_used = 0;
+    }
+  return (PinPointPoint *) arena->blocks->data + arena->n_used++;
+}
+
+/* copies a slice of the source */
+static const char *
+pp_arena_strndup (PPArena    *arena,
+                  const char *str,
+                  gsize       len)
+{
+  return g_string_chunk_insert_len (arena->strings, str, len);
+}
+
+/* like pp_arena_strndup (), returning the same copy for equal strings */
+static const char *
+pp_arena_intern (PPArena    *arena,
+                 const char *str,
+                 gsize       len)
+{
+  g_string_truncate (arena->scratch, 0);
+  g_string_append_len (arena->scratch, str, len);
+  return g_string_chunk_insert_const (arena->strings, arena->scratch->str);
+}
+
+/* 64 bit FNV-1a, telling sources apart for reloads and .pinc files */
+static guint64
+pp_source_hash (const char *src,
+                gsize       len)
+{
+  guint64 hash = G_GUINT64_CONSTANT (14695981039346656037);
+
+  while (len--)
+    {
+      hash ^= (guchar) *src++;
+      hash *= G_GUINT64_CONSTANT (1099511628211);
+    }
+  return hash;
+}
+
+/* Everything a parse produces: the header defaults and the slides, with the
+ * arena owning them. The current presentation is what pp_slides and
+ * point_defaults point into, a reload fills a new one and swaps it in.
  */
+typedef struct
+{
+  GPtrArray     *slides;     /* the points, in presentation order */
+  PinPointPoint  defaults;   /* the built-in ones with the header applied */
+  gsize          header_end; /* end of the header in source */
+  char          *source;     /* copy of what was parsed, to compare a */
+  gsize          source_len; /* reload against */
+  guint64        source_hash;
+  PPArena       *arena;
+} PinPointPresentation;
+
+static PinPointPresentation *pp_presentation = NULL;
+
+static PinPointPresentation *
+pp_presentation_new (gsize source_length)
+{
+  PinPointPresentation *pres = g_new0 (PinPointPresentation, 1);
+
+  pres->slides = g_ptr_array_sized_new (64);
+  pres->defaults = pin_default_point;
+  pres->arena = pp_arena_new (source_length);
+  return pres;
+}
+
+/* renderer is NULL when the renderer data went away with the renderer */
+static void
+pp_presentation_free (PinPointRenderer     *renderer,
+                      PinPointPresentation *pres)
+{
+  guint i;
+
+  if (!pres)
+    return;
+  for (i = 0; renderer && i < pres->slides->len; i++)
+    {
+      PinPointPoint *point = g_ptr_array_index (pres->slides, i);
+
+      if (renderer->free_data && point->data)
+        renderer->free_data (renderer, point->data);
+    }
+  g_ptr_array_free (pres->slides, TRUE);
+  pp_arena_free (pres->arena);
+  g_free (pres->source);
+  g_free (pres);
+}
 
+/* makes pres the current presentation, returning the one it replaces */
+static PinPointPresentation *
+pp_presentation_swap (PinPointPresentation *pres)
+{
+  PinPointPresentation *old = pp_presentation;
+
+  pp_presentation = pres;
+  pp_slides = pres ? pres->slides : NULL;
+  point_defaults = pres ? &pres->defaults : &pin_default_point;
+  return old;
+}
+
+/* drops the current presentation, renderer as for pp_presentation_free () */
+static void
+pp_parse_clear (PinPointRenderer *renderer)
+{
+  pp_presentation_free (renderer, pp_presentation_swap (NULL));
+}
+
+/* a value is always followed by the ']' closing its setting, so the number
+ * parsers below stop there without the slice being terminated */
 static void
 parse_resolution (PPResolution *r,
                   const gchar  *str)
@@ -475,71 +786,104 @@ parse_resolution (PPResolution *r,
 }
 
 static void
-parse_setting (PinPointPoint *point,
-               const char    *setting)
+parse_setting (PPArena       *arena,
+               PinPointPoint *point,
+               const char    *setting,
+               gsize          len)
 {
-/* C Preprocessor macros implemeting a mini language for interpreting
- * pinpoint key=value pairs
+  const char *value    = memchr (setting, '=', len);
+  gsize       name_len = value ? (gsize) (value - setting) : len;
+  gsize       value_len = 0;
+
+  if (value)
+    {
+      value++;
+      value_len = setting + len - value;
+    }
+
+/* C Preprocessor macros implementing a mini language for interpreting
+ * pinpoint key=value pairs and flags. Names are dispatched on their length
+ * first, so a setting is only compared against the few candidates listed
+ * under its LENGTH; anything not matching is a background.
  */
 
-#define START_PARSER if (0) {
-#define DEFAULT      } else {
-#define END_PARSER   }
-#define IF_PREFIX(prefix) } else if (g_str_has_prefix (setting, prefix)) {
-#define IF_EQUAL(string) } else if (g_str_equal (setting, string)) {
-#define STRING  g_intern_string (strchr (setting, '=') + 1)
-#define INT     atoi (strchr (setting, '=') + 1)
-#define FLOAT   g_ascii_strtod (strchr (setting, '=') + 1, NULL)
-#define RESOLUTION(r) parse_resolution (&r, strchr (setting, '=') + 1)
-#define ENUM(r,t,s) \
+#define START_PARSER  switch (name_len) { default: if (0) {
+#define LENGTH(n)     } else goto background; break; case n: if (0) {
+#define END_PARSER    } else goto background; } return; background:
+#define NAME_IS(name) (sizeof (name) - 1 == name_len && \
+                       memcmp (setting, name, name_len) == 0)
+#define IF_KEY(key)   } else if (value && NAME_IS (key)) {
+#define IF_FLAG(flag) } else if (!value && NAME_IS (flag)) {
+#define STRING  pp_arena_intern (arena, value, value_len)
+#define INT     atoi (value)
+#define FLOAT   g_ascii_strtod (value, NULL)
+#define RESOLUTION(r) parse_resolution (&r, value)
+#define ENUM(r,t) \
   do { \
       int _i; \
       EnumDescription *_d = t##_desc; \
       r = _d[0].value; \
       for (_i = 0; _d[_i].name; _i++) \
-        if (g_strcmp0 (_d[_i].name, s) == 0) \
+        if (strlen (_d[_i].name) == value_len && \
+            memcmp (_d[_i].name, value, value_len) == 0) \
           r = _d[_i].value; \
   } while (0)
 
   START_PARSER
-  IF_PREFIX("stage-color=") point->stage_color = STRING;
-  IF_PREFIX("font=")        point->font = STRING;
-  IF_PREFIX("notes-font=")  point->notes_font = STRING;
-  IF_PREFIX("notes-font-size=")  point->notes_font_size = STRING;
-  IF_PREFIX("text-color=")  point->text_color = STRING;
-  IF_PREFIX("text-align=")  ENUM(point->text_align, PPTextAlign, STRING);
-  IF_PREFIX("shading-color=") point->shading_color = STRING;
-  IF_PREFIX("shading-opacity=") point->shading_opacity = FLOAT;
-  IF_PREFIX("duration=")   point->duration = FLOAT;
-  IF_PREFIX("command=")    point->command = STRING;
-  IF_PREFIX("transition=") point->transition = STRING;
-  IF_PREFIX("camera-framerate=")  point->camera_framerate = INT;
-  IF_PREFIX("camera-resolution=") RESOLUTION (point->camera_resolution);
-  IF_EQUAL("fill")         point->bg_scale = PP_BG_FILL;
-  IF_EQUAL("fit")          point->bg_scale = PP_BG_FIT;
-  IF_EQUAL("stretch")      point->bg_scale = PP_BG_STRETCH;
-  IF_EQUAL("unscaled")     point->bg_scale = PP_BG_UNSCALED;
-  IF_PREFIX("bg-position=") ENUM(point->bg_position, PPGravity, STRING);
-  IF_EQUAL("center")       point->position = CLUTTER_GRAVITY_CENTER;
-  IF_EQUAL("top")          point->position = CLUTTER_GRAVITY_NORTH;
-  IF_EQUAL("bottom")       point->position = CLUTTER_GRAVITY_SOUTH;
-  IF_EQUAL("left")         point->position = CLUTTER_GRAVITY_WEST;
-  IF_EQUAL("right")        point->position = CLUTTER_GRAVITY_EAST;
-  IF_EQUAL("top-left")     point->position = CLUTTER_GRAVITY_NORTH_WEST;
-  IF_EQUAL("top-right")    point->position = CLUTTER_GRAVITY_NORTH_EAST;
-  IF_EQUAL("bottom-left")  point->position = CLUTTER_GRAVITY_SOUTH_WEST;
-  IF_EQUAL("bottom-right") point->position = CLUTTER_GRAVITY_SOUTH_EAST;
-  IF_EQUAL("no-markup")    point->use_markup = FALSE;
-  IF_EQUAL("markup")       point->use_markup = TRUE;
-  DEFAULT                  point->bg = g_intern_string (setting);
+  LENGTH(3)
+  IF_FLAG("fit")            point->bg_scale = PP_BG_FIT;
+  IF_FLAG("top")            point->position = CLUTTER_GRAVITY_NORTH;
+  LENGTH(4)
+  IF_KEY("font")            point->font = STRING;
+  IF_FLAG("fill")           point->bg_scale = PP_BG_FILL;
+  IF_FLAG("left")           point->position = CLUTTER_GRAVITY_WEST;
+  LENGTH(5)
+  IF_FLAG("right")          point->position = CLUTTER_GRAVITY_EAST;
+  LENGTH(6)
+  IF_FLAG("center")         point->position = CLUTTER_GRAVITY_CENTER;
+  IF_FLAG("bottom")         point->position = CLUTTER_GRAVITY_SOUTH;
+  IF_FLAG("markup")         point->use_markup = TRUE;
+  LENGTH(7)
+  IF_KEY("command")         point->command = STRING;
+  IF_FLAG("stretch")        point->bg_scale = PP_BG_STRETCH;
+  LENGTH(8)
+  IF_KEY("duration")        point->duration = FLOAT;
+  IF_FLAG("unscaled")       point->bg_scale = PP_BG_UNSCALED;
+  IF_FLAG("top-left")       point->position = CLUTTER_GRAVITY_NORTH_WEST;
+  LENGTH(9)
+  IF_FLAG("top-right")      point->position = CLUTTER_GRAVITY_NORTH_EAST;
+  IF_FLAG("no-markup")      point->use_markup = FALSE;
+  LENGTH(10)
+  IF_KEY("notes-font")      point->notes_font = STRING;
+  IF_KEY("text-color")      point->text_color = STRING;
+  IF_KEY("text-align")      ENUM(point->text_align, PPTextAlign);
+  IF_KEY("transition")      point->transition = STRING;
+  LENGTH(11)
+  IF_KEY("stage-color")     point->stage_color = STRING;
+  IF_KEY("bg-position")     ENUM(point->bg_position, PPGravity);
+  IF_FLAG("bottom-left")    point->position = CLUTTER_GRAVITY_SOUTH_WEST;
+  LENGTH(12)
+  IF_FLAG("bottom-right")   point->position = CLUTTER_GRAVITY_SOUTH_EAST;
+  LENGTH(13)
+  IF_KEY("shading-color")   point->shading_color = STRING;
+  LENGTH(15)
+  IF_KEY("notes-font-size") point->notes_font_size = STRING;
+  IF_KEY("shading-opacity") point->shading_opacity = FLOAT;
+  LENGTH(16)
+  IF_KEY("camera-framerate")  point->camera_framerate = INT;
+  LENGTH(17)
+  IF_KEY("camera-resolution") RESOLUTION (point->camera_resolution);
   END_PARSER
 
+  point->bg = pp_arena_intern (arena, setting, len);
+
 /* undefine the overrides, returning us to regular C */
 #undef START_PARSER
+#undef LENGTH
 #undef END_PARSER
-#undef DEFAULT
-#undef IF_PREFIX
-#undef IF_EQUAL
+#undef NAME_IS
+#undef IF_KEY
+#undef IF_FLAG
 #undef FLOAT
 #undef STRING
 #undef INT
@@ -548,62 +892,196 @@ parse_setting (PinPointPoint *point,
 }
 
 static void
-parse_config (PinPointPoint *point,
-              const char    *config)
+parse_config (PPArena       *arena,
+              PinPointPoint *point,
+              const char    *config,
+              gsize          len)
 {
-  GString    *str = g_string_new ("");
-  const char *p;
+  const char *end = config + len;
+  const char *p   = config;
 
-  for (p = config; *p; p++)
+  while ((p = memchr (p, '[', end - p)))
     {
-      if (*p != '[')
-        continue;
-
-      p++;
-      g_string_truncate (str, 0);
-      while (*p && *p != ']' && *p != '\n')
-        {
-          g_string_append_c (str, *p);
-          p++;
-        }
+      const char *start = ++p;
 
+      while (p < end && *p != ']' && *p != '\n')
+        p++;
+      if (p == end)
+        break;
       if (*p == ']')
-        parse_setting (point, str->str);
+        parse_setting (arena, point, start, p - start);
     }
-  g_string_free (str, TRUE);
 }
 
+/* Collects the text of a slide (or the header) as a slice of the source for
+ * as long as its pieces are adjacent there, switching to a copy once comment
+ * lines or escapes have to be cut out.
+ */
+typedef struct
+{
+  const char *str;
+  gsize       len;
+  gboolean    copied;
+  GString    *copy;
+} PPText;
+
 static void
-pin_point_free (PinPointRenderer *renderer,
-                PinPointPoint    *point)
+pp_text_append (PPText     *text,
+                const char *str,
+                gsize       len)
 {
-  if (renderer->free_data)
-    renderer->free_data (renderer, point->data);
-  if (point->speaker_notes)
+  if (!text->copied)
+    {
+      if (!text->str)
+        {
+          text->str = str;
+          text->len = len;
+          return;
+        }
+      if (text->str + text->len == str)
+        {
+          text->len += len;
+          return;
+        }
+      g_string_truncate (text->copy, 0);
+      g_string_append_len (text->copy, text->str, text->len);
+      text->copied = TRUE;
+    }
+  g_string_append_len (text->copy, str, len);
+}
+
+static const char *
+pp_text_get (PPText *text,
+             gsize  *len)
+{
+  if (text->copied)
     {
-      g_free (point->speaker_notes);
+      *len = text->copy->len;
+      return text->copy->str;
     }
-  g_free (point);
+  *len = text->len;
+  return text->str ? text->str : "";
 }
 
+static void
+pp_text_reset (PPText *text)
+{
+  text->str = NULL;
+  text->len = 0;
+  text->copied = FALSE;
+}
+
+/* the renderer data is only attached when the point gets made, on the main
+ * thread */
 static PinPointPoint *
-pin_point_new (PinPointRenderer *renderer)
+pin_point_new (PinPointPresentation *pres)
 {
   PinPointPoint *point;
 
-  point = g_new0 (PinPointPoint, 1);
-  *point = default_point;
+  point = pp_arena_new_point (pres->arena);
+  *point = pres->defaults;
+  return point;
+}
+
+/*
+ * Styles
+ *
+ * Colors and fonts are resolved once, by the parser, into a table shared by
+ * all slides and reloads, equal strings giving the same entry. The entries
+ * are immutable and never freed, the tables are locked as reloads are parsed
+ * on another thread.
+ */
+
+typedef struct
+{
+  ClutterColor color; /* first, entries are handed out as colors */
+  gboolean     valid;
+} PPStyleColor;
+
+static GHashTable *pp_style_colors = NULL;
+static GHashTable *pp_style_fonts  = NULL;
+G_LOCK_DEFINE_STATIC (pp_style);
 
-  if (renderer->allocate_data)
-      point->data = renderer->allocate_data (renderer);
+static const PPStyleColor *
+pp_style_color_entry (const char *string)
+{
+  PPStyleColor *entry;
 
-  return point;
+  G_LOCK (pp_style);
+  if (!pp_style_colors)
+    pp_style_colors = g_hash_table_new (g_str_hash, g_str_equal);
+
+  entry = g_hash_table_lookup (pp_style_colors, string);
+  if (!entry)
+    {
+      entry = g_new0 (PPStyleColor, 1);
+      entry->valid = clutter_color_from_string (&entry->color, string);
+      if (!entry->valid) /* what a broken stage color has always meant */
+        clutter_color_init (&entry->color, 0, 0, 0, 0xff);
+      g_hash_table_insert (pp_style_colors, g_strdup (string), entry);
+    }
+  G_UNLOCK (pp_style);
+  return entry;
+}
+
+/* returns the shared color for string, opaque black if string is not a color
+ * and NULL for NULL */
+const ClutterColor *
+pp_style_color (const char *string)
+{
+  if (!string)
+    return NULL;
+  return &pp_style_color_entry (string)->color;
+}
+
+/* returns the shared font description for string, NULL for NULL */
+const PangoFontDescription *
+pp_style_font (const char *string)
+{
+  PangoFontDescription *desc;
+
+  if (!string)
+    return NULL;
+
+  G_LOCK (pp_style);
+  if (!pp_style_fonts)
+    pp_style_fonts = g_hash_table_new (g_str_hash, g_str_equal);
+
+  desc = g_hash_table_lookup (pp_style_fonts, string);
+  if (!desc)
+    {
+      desc = pango_font_description_from_string (string);
+      g_hash_table_insert (pp_style_fonts, g_strdup (string), desc);
+    }
+  G_UNLOCK (pp_style);
+  return desc;
+}
+
+/* points the resolved colors and font of point at the table */
+static void
+pp_resolve_style (PinPointPoint *point)
+{
+  point->stage_rgba = pp_style_color (point->stage_color);
+  point->text_rgba = pp_style_color (point->text_color);
+  point->shading_rgba = pp_style_color (point->shading_color);
+  if (point->bg_type == PP_BG_COLOR)
+    point->bg_rgba = pp_style_color (point->bg);
+  point->font_desc = pp_style_font (point->font);
 }
 
+/* only colors go into the table, not the name of every image */
 static gboolean
 pp_is_color (const char *string)
 {
-  ClutterColor color;
+  const PPStyleColor *entry = NULL;
+  ClutterColor        color;
+
+  G_LOCK (pp_style);
+  if (pp_style_colors)
+    entry = g_hash_table_lookup (pp_style_colors, string);
+  G_UNLOCK (pp_style);
+  if (entry)
+    return entry->valid;
   return clutter_color_from_string (&color, string);
 }
 
@@ -758,7 +1236,7 @@ static void serialize_slide (GString *str,
 {
   g_string_append_c (str, '\n');
   g_string_append (str, "--");
-  serialize_slide_config (str, point, &default_point, " ");
+  serialize_slide_config (str, point, point_defaults, " ");
   g_string_append (str, "\n");
 
   g_string_append_printf (str, "%s\n", point->text);
@@ -787,208 +1265,1419 @@ static char * pp_serialize (void)
 {
   GString *str = g_string_new ("#!/usr/bin/env pinpoint\n");
   char *ret;
-  GList *iter;
+  PinPointPoint *point;
+  gint i;
 
-  serialize_slide_config (str, &default_point, &pin_default_point, "\n");
+  serialize_slide_config (str, point_defaults, &pin_default_point, "\n");
 
-  for (iter = pp_slides; iter; iter = iter->next)
+  for (i = 0; (point = pp_slide_nth (i)); i++)
     {
-      serialize_slide (str, iter->data);
+      serialize_slide (str, point);
     }
   ret = str->str;
   g_string_free (str, FALSE);
   return ret;
 }
 
-void
-pp_parse_slides (PinPointRenderer *renderer,
-                 const char       *slide_src)
-{
-  const char *p;
-  int         slideno     = 0;
-  gboolean    done        = FALSE;
-  gboolean    startofline = TRUE;
-  gboolean    gotconfig   = FALSE;
-  GString    *slide_str   = g_string_new ("");
-  GString    *setting_str = g_string_new ("");
-  GString    *notes_str   = g_string_new ("");
-  GList      *s;
-  PinPointPoint *point, *next_point;
-
-  if (renderer->source)
-    {
-      gboolean start_of_line = TRUE;
-      int pos;
-      int lineno=0;
-      /* compute slide no that has changed */
-      for (pos = 0, slideno = 0;
-           slide_src[pos] &&
-           renderer->source[pos] &&
-           slide_src[pos]==renderer->source[pos]
-           ; pos ++)
+/*
+ * When reloading, bytes [0, prefix) and the last suffix bytes of the new
+ * source are identical to the old one. A slide lying entirely inside one of
+ * those ranges (with its separator line starting inside it too) parses to the
+ * same point as before, as long as the header did not change, and can keep
+ * the renderer data that was made for it.
+ */
+typedef struct
+{
+  GPtrArray *old_slides; /* points of the previous parse, in source order */
+  guint  old_index;
+  gsize  old_len;
+  gsize  new_len;
+  gsize  prefix;
+  gsize  suffix;
+} PPReuse;
+
+static PinPointPoint *
+pp_reuse_lookup (PPReuse *reuse,
+                 gsize    start,
+                 gsize    end)
+{
+  gsize old_start, old_end;
+
+  if (end < reuse->prefix ||
+      (end == reuse->new_len && reuse->new_len == reuse->old_len &&
+       reuse->prefix == reuse->new_len))
+    {
+      old_start = start;
+      old_end = end;
+    }
+  else if (start > reuse->new_len - reuse->suffix)
+    {
+      old_start = start + reuse->old_len - reuse->new_len;
+      old_end = end + reuse->old_len - reuse->new_len;
+    }
+  else
+    return NULL;
+
+  /* both parses yield spans in increasing order, so the old list is walked
+   * only once during a parse */
+  while (reuse->old_slides && reuse->old_index < reuse->old_slides->len)
+    {
+      PinPointPoint *old = g_ptr_array_index (reuse->old_slides,
+                                              reuse->old_index);
+
+      if (old->source_start > old_start)
+        break;
+      reuse->old_index++;
+      if (old->source_start == old_start &&
+          old->source_end == old_end)
+        return old;
+    }
+  return NULL;
+}
+
+/* The parser only reads the presentation it replaces and fills a new one,
+ * so that it can run on another thread. Attaching the renderer data to the
+ * new slides, pp_parser_make (), and making them current is left to the
+ * main thread.
+ */
+typedef struct
+{
+  PinPointRenderer     *renderer;
+  const char           *src;
+  const char           *p;             /* start of the next line to parse */
+  const char           *end;
+  gboolean              hashed;
+  gboolean              started;
+  gboolean              done;
+  PinPointPresentation *pres;          /* being filled */
+  PinPointPresentation *old;           /* the current one when started */
+  GPtrArray            *reused;        /* for each slide of pres, the old
+                                          point it takes over, or NULL */
+  guint                 n_made;        /* slides of pres made so far */
+  PinPointPoint        *point;         /* slide being parsed, NULL in the header */
+  PPText                text;
+  GString              *notes;
+  PPReuse               reuse;
+  gboolean              can_reuse;
+  gint                  changed_slide; /* slide containing the first edit */
+  guint                 made;
+} PPParser;
+
+static void
+pp_parser_hash (PPParser *parser)
+{
+  if (parser->hashed)
+    return;
+  parser->pres->source_hash = pp_source_hash (parser->src,
+                                              parser->end - parser->src);
+  parser->hashed = TRUE;
+}
+
+/* compares the new source with the one of the old presentation */
+static void
+pp_parser_init_reuse (PPParser *parser)
+{
+  PPReuse    *reuse = &parser->reuse;
+  const char *src   = parser->src;
+  const char *old;
+
+  reuse->new_len = parser->end - parser->src;
+  if (!parser->old || !parser->old->source)
+    return;
+
+  old = parser->old->source;
+  reuse->old_len = parser->old->source_len;
+  reuse->old_slides = parser->old->slides;
+  while (reuse->prefix < reuse->old_len &&
+         reuse->prefix < reuse->new_len &&
+         old[reuse->prefix] == src[reuse->prefix])
+    reuse->prefix++;
+  while (reuse->suffix < reuse->old_len - reuse->prefix &&
+         reuse->suffix < reuse->new_len - reuse->prefix &&
+         src[reuse->new_len - reuse->suffix - 1] ==
+         old[reuse->old_len - reuse->suffix - 1])
+    reuse->suffix++;
+  parser->can_reuse = TRUE;
+}
+
+static void
+pp_parse_close_header (PPParser *parser,
+                       gsize     pos)
+{
+  PinPointPresentation *pres = parser->pres;
+  const char           *config;
+  gsize                 len;
+
+  config = pp_text_get (&parser->text, &len);
+  parse_config (pres->arena, &pres->defaults, config, len);
+
+  pres->header_end = pos;
+  if (!parser->old ||
+      pres->header_end != parser->old->header_end ||
+      pres->header_end >= parser->reuse.prefix)
+    parser->can_reuse = FALSE;
+}
+
+/* resolves bg against the directory of the presentation, as it is reached
+ * from the current directory now */
+static void
+pp_resolve_bg_file (PinPointPresentation *pres,
+                    PinPointPoint        *point)
+{
+  if (point->bg && point->bg_type != PP_BG_COLOR && pp_source_dir)
+    {
+      char *path = g_build_filename (pp_source_dir, point->bg, NULL);
+
+      point->bg_file = pp_arena_intern (pres->arena, path, strlen (path));
+      g_free (path);
+    }
+  else
+    point->bg_file = point->bg;
+}
+
+static void
+pp_parse_close_slide (PPParser *parser,
+                      gsize     pos)
+{
+  PinPointPresentation *pres = parser->pres;
+  PinPointPoint        *point = parser->point;
+  PinPointPoint        *old = NULL;
+  const char           *str;
+  gsize                 len;
+
+  point->source_end = pos;
+
+  if (point->bg && point->bg[0])
+    {
+      char *filename = g_strdup (point->bg);
+      int i = 0;
+
+      while (filename[i])
         {
-          switch (slide_src[pos])
-            {
-              case '\n':
-                start_of_line = TRUE;
-                lineno++;
-                break;
-              case '-':
-                if (start_of_line)
-                  slideno++;
-              default:
-                start_of_line = FALSE;
-            }
+          filename[i] = tolower(filename[i]);
+          i++;
         }
-      slideno-=1;
-      g_free (renderer->source);
+
+      if (strcmp (filename, "camera") == 0)
+        point->bg_type = PP_BG_CAMERA;
+      else if (str_has_video_suffix (filename))
+        point->bg_type = PP_BG_VIDEO;
+      else if (g_str_has_suffix (filename, ".svg"))
+        point->bg_type = PP_BG_SVG;
+      else if (pp_is_color (point->bg))
+        point->bg_type = PP_BG_COLOR;
+      else
+        point->bg_type = PP_BG_IMAGE;
+      g_free (filename);
+    }
+
+  pp_resolve_bg_file (pres, point);
+  pp_resolve_style (point);
+
+  /* trim newlines from start and end. ' ' can be used in the insane case
+   * that you actually want blank lines before or after the text of a slide */
+  str = pp_text_get (&parser->text, &len);
+  while (len && *str == '\n')
+    {
+      str++;
+      len--;
     }
-  renderer->source = g_strdup (slide_src);
+  while (len && str[len - 1] == '\n')
+    len--;
+  point->text = pp_arena_strndup (pres->arena, str, len);
+
+  if (parser->notes->len)
+    point->speaker_notes = (char *) pp_arena_strndup (pres->arena,
+                                                      parser->notes->str,
+                                                      parser->notes->len);
+
+  if (point->source_start < parser->reuse.prefix)
+    parser->changed_slide = pres->slides->len;
+
+  if (parser->can_reuse)
+    old = pp_reuse_lookup (&parser->reuse, point->source_start,
+                           point->source_end);
+
+  g_ptr_array_add (parser->reused, old);
+  g_ptr_array_add (pres->slides, point);
+  parser->point = NULL;
+}
+
+/* ends the header or slide before pos */
+static void
+pp_parse_close (PPParser *parser,
+                gsize     pos)
+{
+  if (parser->point)
+    pp_parse_close_slide (parser, pos);
+  else
+    pp_parse_close_header (parser, pos);
+
+  pp_text_reset (&parser->text);
+  g_string_truncate (parser->notes, 0);
+}
+
+/* Sets up the parsing of slide_src, which has to stay around until
+ * pp_parser_finish (), into a new presentation. The current one has to stay
+ * around as well, the new slides take over what they can from it.
+ */
+static PPParser *
+pp_parser_new (PinPointRenderer *renderer,
+               const char       *slide_src,
+               gsize             length)
+{
+  PPParser *parser = g_new0 (PPParser, 1);
+
+  if (!slide_src) /* what an empty mapped file gives */
+    slide_src = "";
+
+  parser->renderer = renderer;
+  parser->src = parser->p = slide_src;
+  parser->end = slide_src + length;
+  parser->pres = pp_presentation_new (length);
+  parser->old = pp_presentation;
+  parser->reused = g_ptr_array_sized_new (64);
+  parser->text.copy = g_string_new ("");
+  parser->notes = g_string_new ("");
 
-  for (s = pp_slides; s; s = s->next)
-    pin_point_free (renderer, s->data);
+  return parser;
+}
+
+/* parses up to n_slides more slides, returns FALSE once all are done */
+static gboolean
+pp_parser_step (PPParser *parser,
+                guint     n_slides)
+{
+  const char *src = parser->src;
+  const char *end = parser->end;
+  const char *p   = parser->p;
+  GPtrArray  *slides = parser->pres->slides;
+  guint       start = slides->len;
 
-  g_list_free (pp_slides);
-  pp_slides = NULL;
-  point = pin_point_new (renderer);
+  if (parser->done)
+    return FALSE;
 
-  /* parse the slides, constructing lists of slide/point objects
-   */
-  for (p = slide_src; *p; p++)
+  if (!parser->started)
     {
+      pp_parser_hash (parser);
+      pp_parser_init_reuse (parser);
+      parser->started = TRUE;
+    }
+
+  /* one line per iteration, p is always at the start of a line */
+  while (p < end && slides->len - start < n_slides)
+    {
+      const char *eol = memchr (p, '\n', end - p);
+      const char *next = eol ? eol + 1 : end;
+      const char *run, *q;
+
+      if (!eol)
+        eol = end;
+
       switch (*p)
         {
-          case '\\': /* escape the next char */
-            p++;
-            startofline = FALSE;
-            if (*p)
-              g_string_append_c (slide_str, *p);
-            break;
-          case '\n':
-            startofline = TRUE;
-            g_string_append_c (slide_str, *p);
-            break;
-          case '-': /* slide seperator */
-            close_last_slide:
-            if (startofline)
-              {
-                next_point = pin_point_new (renderer);
-
-                g_string_assign (setting_str, "");
-                while (*p && *p!='\n')  /* until newline */
-                  {
-                    g_string_append_c (setting_str, *p);
-                    p++;
-                  }
-                parse_config (next_point, setting_str->str);
-
-                if (!gotconfig)
-                  {
-                    parse_config (&default_point, slide_str->str);
-                    /* copy the default point except the per-slide allocated
-                     * data (void *) */
-                    memcpy (point, &default_point,
-                            sizeof (PinPointPoint) - sizeof (void *));
-                    parse_config (point, setting_str->str);
-                    gotconfig = TRUE;
-                    g_string_assign (slide_str, "");
-                    g_string_assign (setting_str, "");
-                    g_string_assign (notes_str, "");
-                  }
-                else
-                  {
-                    if (point->bg && point->bg[0])
-                      {
-                        char *filename = g_strdup (point->bg);
-                        int i = 0;
-
-                        while (filename[i])
-                          {
-                            filename[i] = tolower(filename[i]);
-                            i++;
-                          }
-
-                        if (strcmp (filename, "camera") == 0)
-                          point->bg_type = PP_BG_CAMERA;
-                        else if (str_has_video_suffix (filename))
-                          point->bg_type = PP_BG_VIDEO;
-                        else if (g_str_has_suffix (filename, ".svg"))
-                          point->bg_type = PP_BG_SVG;
-                        else if (pp_is_color (point->bg))
-                          point->bg_type = PP_BG_COLOR;
-                        else
-                          point->bg_type = PP_BG_IMAGE;
-                        g_free (filename);
-                      }
-
-                    {
-                      char *str = slide_str->str;
-
-                    /* trim newlines from start and end. ' ' can be used in the
-                     * insane case that you actually want blank lines before or
-                     * after the text of a slide */
-                      while (*str == '\n') str++;
-                      while ( slide_str->str[strlen(slide_str->str)-1]=='\n')
-                        slide_str->str[strlen(slide_str->str)-1]='\0';
-
-                      point->text = g_intern_string (str);
-                    }
-                    if (notes_str->str[0])
-                      point->speaker_notes = g_strdup (notes_str->str);
-
-                    renderer->make_point (renderer, point);
-
-                    g_string_assign (slide_str, "");
-                    g_string_assign (setting_str, "");
-                    g_string_assign (notes_str, "");
-
-                    pp_slides = g_list_append (pp_slides, point);
-                    point = next_point;
-                  }
-              }
-            else
+          case '-': /* slide separator, with the settings of the new slide */
+            pp_parse_close (parser, p - src);
+            parser->point = pin_point_new (parser->pres);
+            parser->point->source_start = p - src;
+            parse_config (parser->pres->arena, parser->point, p, eol - p);
+            p = next;
+            continue;
+
+          case '#': /* comment */
+            if (!pp_ignore_comments)
               {
-                g_string_append_c (slide_str, *p);
+                g_string_append_len (parser->notes, p + 1, eol - p - 1);
+                g_string_append_c (parser->notes, '\n');
               }
-            break;
-        case '#': /* comment */
-          if (startofline)
+            p = next;
+            continue;
+        }
+
+      if (!memchr (p, '\\', eol - p))
+        {
+          pp_text_append (&parser->text, p, next - p);
+          p = next;
+          continue;
+        }
+
+      /* a line with escapes: take the runs between them, the escaped char
+       * starting the next run. An escaped newline joins the following line
+       * to this one, so that one can not start a slide or comment */
+      for (run = q = p; q < end; q++)
+        {
+          if (*q == '\\')
             {
-              const char *end = p + 1;
-              while (*end != '\n' && *end != '\0')
-                {
-                  if (!pp_ignore_comments)
-                    g_string_append_c (notes_str, *end);
-                  end++;
-                }
-              if (end)
-                {
-                  if (!pp_ignore_comments)
-                    g_string_append_c (notes_str, '\n');
-                  p = end;
-                  break;
-                }
+              pp_text_append (&parser->text, run, q - run);
+              run = ++q;
+              if (q == end)
+                break;
+            }
+          else if (*q == '\n')
+            {
+              q++;
+              break;
             }
-          /* flow through */
-          default:
-            startofline = FALSE;
-            g_string_append_c (slide_str, *p);
-            break;
         }
+      pp_text_append (&parser->text, run, q - run);
+      p = q;
     }
+  parser->p = p;
 
-  if (!done)
-    {
-      done = TRUE;
-      goto close_last_slide;
-    }
+  if (p < end)
+    return TRUE;
+
+  pp_parse_close (parser, end - src);
+  parser->pres->source = g_strndup (src, end - src);
+  parser->pres->source_len = end - src;
+  parser->done = TRUE;
+  return FALSE;
+}
 
-  g_string_free (slide_str, TRUE);
-  g_string_free (setting_str, TRUE);
-  g_string_free (notes_str, TRUE);
+/* attaches renderer data to the slides parsed since the last call, taking it
+ * over from the old point where the parser found one */
+static void
+pp_parser_make (PPParser *parser)
+{
+  PinPointRenderer *renderer = parser->renderer;
+  GPtrArray        *slides   = parser->pres->slides;
 
-  if (g_list_nth (pp_slides, slideno))
-    pp_slidep = g_list_nth (pp_slides, slideno);
-  else
-    pp_slidep = pp_slides;
+  for (; parser->n_made < slides->len; parser->n_made++)
+    {
+      PinPointPoint *point = g_ptr_array_index (slides, parser->n_made);
+      PinPointPoint *old = g_ptr_array_index (parser->reused, parser->n_made);
+
+      if (old && old->data)
+        {
+          /* same source, same defaults: steal what the renderer made for
+           * the old point */
+          point->data = old->data;
+          point->new_duration = old->new_duration;
+          old->data = NULL;
+          continue;
+        }
+
+      if (renderer->allocate_data)
+        point->data = renderer->allocate_data (renderer);
+      renderer->make_point (renderer, point);
+      parser->made++;
+    }
+}
+
+/* frees the parser, not what it parsed */
+static void
+pp_parser_free (PPParser *parser)
+{
+  g_ptr_array_free (parser->reused, TRUE);
+  g_string_free (parser->text.copy, TRUE);
+  g_string_free (parser->notes, TRUE);
+  g_free (parser);
+}
+
+/* parses what is left, makes the new presentation current, frees the parser
+ * and the presentation it replaced and returns the number of points the
+ * renderer had to make */
+static guint
+pp_parser_finish (PPParser *parser)
+{
+  guint made;
+
+  while (pp_parser_step (parser, G_MAXUINT));
+  pp_parser_make (parser);
+
+  /* a streamed presentation is current already. Whatever was not taken
+   * over by a new point goes away now */
+  if (pp_presentation != parser->pres)
+    pp_presentation_swap (parser->pres);
+  pp_presentation_free (parser->renderer, parser->old);
+
+  /* a reload goes to the first changed slide, a first load to the start
+   * unless something was shown already */
+  if (parser->old || !pp_slide_nth (pp_slide_no))
+    {
+      if (pp_slide_nth (parser->changed_slide))
+        pp_slide_no = parser->changed_slide;
+      else
+        pp_slide_no = pp_slides->len ? 0 : -1;
+    }
+
+  made = parser->made;
+  pp_parser_free (parser);
+  return made;
+}
+
+guint
+pp_parse_slides (PinPointRenderer *renderer,
+                 const char       *slide_src,
+                 gsize             length)
+{
+  pp_parse_wait ();
+  pp_stream_finish ();
+  return pp_parser_finish (pp_parser_new (renderer, slide_src, length));
+}
+
+/*
+ * Streaming
+ *
+ * A presentation given to pp_stream_slides () gets its header and first
+ * slides parsed right away, so that they can be shown, and the rest parsed
+ * (and made by the renderer) from idle callbacks.
+ */
+
+#define PP_STREAM_FIRST  3    /* slides parsed before returning */
+#define PP_STREAM_BUDGET 5000 /* microseconds of parsing per idle callback */
+
+static PPParser    *pp_stream      = NULL;
+static GMappedFile *pp_stream_file = NULL;
+static guint        pp_stream_idle = 0;
+
+static gboolean
+pp_stream_step (gpointer data)
+{
+  gint64 start = g_get_monotonic_time ();
+
+  while (pp_parser_step (pp_stream, 1))
+    {
+      pp_parser_make (pp_stream);
+      if (g_get_monotonic_time () - start > PP_STREAM_BUDGET)
+        return TRUE;
+    }
+
+  pp_stream_idle = 0;
+  pp_stream_finish ();
+  return FALSE;
+}
+
+void
+pp_stream_slides (PinPointRenderer *renderer,
+                  GMappedFile      *mapped)
+{
+  pp_parse_wait ();
+  pp_stream_finish ();
+
+  pp_stream_file = g_mapped_file_ref (mapped);
+  pp_stream = pp_parser_new (renderer,
+                             g_mapped_file_get_contents (mapped),
+                             g_mapped_file_get_length (mapped));
+
+  if (!pp_parser_step (pp_stream, PP_STREAM_FIRST))
+    {
+      pp_stream_finish ();
+      return;
+    }
+
+  /* the slides parsed so far are shown while the rest comes in */
+  pp_parser_make (pp_stream);
+  pp_presentation_swap (pp_stream->pres);
+  if (!pp_slide_nth (pp_slide_no))
+    pp_slide_no = pp_slides->len ? 0 : -1;
+  pp_stream_idle = g_idle_add (pp_stream_step, NULL);
+}
+
+/* parses whatever pp_stream_slides () has left, for when all the slides are
+ * needed now */
+void
+pp_stream_finish (void)
+{
+  if (!pp_stream)
+    return;
+
+  if (pp_stream_idle)
+    g_source_remove (pp_stream_idle);
+  pp_stream_idle = 0;
+
+  pp_parser_finish (pp_stream);
+  pp_stream = NULL;
+  g_mapped_file_unref (pp_stream_file);
+  pp_stream_file = NULL;
+}
+
+/*
+ * Reloading in the background
+ *
+ * pp_parse_slides_async () parses on a worker thread while the current
+ * presentation keeps being shown, the main loop is only left with making
+ * the changed slides and swapping the presentations. A source hashing the
+ * same as the current one, or as what pinpoint saved itself, is not parsed
+ * at all.
+ */
+
+typedef struct
+{
+  PPParser    *parser;
+  GMappedFile *mapped;
+  GThread     *thread;
+  guint        idle;   /* of pp_parse_job_done (), added by the thread */
+  guint64      saved_hash;  /* pp_saved_hash when it started */
+  gboolean     unchanged;
+  PPParseDone  done;
+  gpointer     data;
+} PPParseJob;
+
+static PPParseJob *pp_parse_job = NULL; /* the one in progress */
+
+static void
+pp_parse_job_finish (PPParseJob *job)
+{
+  PinPointRenderer *renderer = job->parser->renderer;
+  guint             made = 0;
+
+  pp_parse_job = NULL;
+  if (job->unchanged)
+    {
+      /* the saved source is what is shown, a later reload of the source
+       * it was parsed from does change something */
+      if (job->parser->old)
+        job->parser->old->source_hash = job->parser->pres->source_hash;
+      pp_presentation_free (NULL, job->parser->pres);
+      pp_parser_free (job->parser);
+    }
+  else
+    {
+      made = pp_parser_finish (job->parser);
+    }
+  /* the source this job read is shown now. A save since it started is
+   * left for the reload that save triggers */
+  if (pp_saved_hash == job->saved_hash)
+    pp_saved_hash = 0;
+  g_mapped_file_unref (job->mapped);
+  if (job->done)
+    job->done (renderer, !job->unchanged, made, job->data);
+  g_free (job);
+}
+
+static gboolean
+pp_parse_job_done (gpointer data)
+{
+  PPParseJob *job = data;
+
+  g_thread_join (job->thread);
+  pp_parse_job_finish (job);
+  return FALSE;
+}
+
+static gpointer
+pp_parse_thread (gpointer data)
+{
+  PPParseJob *job    = data;
+  PPParser   *parser = job->parser;
+
+  pp_parser_hash (parser);
+  job->unchanged = (parser->old &&
+                    parser->pres->source_hash == parser->old->source_hash) ||
+                   parser->pres->source_hash == job->saved_hash;
+
+  if (!job->unchanged)
+    while (pp_parser_step (parser, G_MAXUINT));
+  job->idle = g_idle_add (pp_parse_job_done, job);
+  return NULL;
+}
+
+/* finishes the background parse in progress, if any, right away */
+static void
+pp_parse_wait (void)
+{
+  PPParseJob *job = pp_parse_job;
+
+  if (!job)
+    return;
+
+  g_thread_join (job->thread);
+  g_source_remove (job->idle);
+  pp_parse_job_finish (job);
+}
+
+void
+pp_parse_slides_async (PinPointRenderer *renderer,
+                       GMappedFile      *mapped,
+                       PPParseDone       done,
+                       gpointer          data)
+{
+  PPParseJob *job;
+
+  pp_parse_wait ();
+  pp_stream_finish ();
+
+  job = g_new0 (PPParseJob, 1);
+  job->mapped = g_mapped_file_ref (mapped);
+  job->parser = pp_parser_new (renderer,
+                               g_mapped_file_get_contents (mapped),
+                               g_mapped_file_get_length (mapped));
+  job->saved_hash = pp_saved_hash;
+  job->done = done;
+  job->data = data;
+
+  pp_parse_job = job;
+  job->thread = g_thread_new ("pinpoint-parse", pp_parse_thread, job);
+}
+
+/*
+ * Precompiled presentations
+ *
+ * pinpoint --compile deck.pin writes deck.pinc: the parsed header and slides
+ * with their settings, text and notes, and the resolved file and size of
+ * their backgrounds. When deck.pin is shown later, a .pinc compiled from a
+ * source with the same size, mtime and hash is mapped and its points used as
+ * they are instead of parsing, the strings staying in the mapping. Numbers
+ * are in host byte order, a .pinc from another architecture or version is
+ * ignored like a stale one.
+ */
+
+#define PP_PINC_MAGIC   0x434e4950 /* "PINC" on little endian */
+#define PP_PINC_VERSION 2
+
+typedef struct
+{
+  guint32 magic;
+  guint32 version;
+  guint32 point_size;       /* sizeof (PPPincPoint) */
+  guint32 n_points;         /* the header defaults, then the slides */
+  guint32 ignore_comments;  /* the notes depend on it */
+  guint32 pad;
+  guint64 source_size;
+  gint64  source_mtime;
+  guint64 source_hash;
+  guint64 header_end;
+  guint64 strings_size;     /* of the strings following the points */
+} PPPincHeader;
+
+/* the string members of a point, stored as offsets into the strings with 0
+ * for NULL */
+static const gsize pp_pinc_strings[] =
+{
+  G_STRUCT_OFFSET (PinPointPoint, stage_color),
+  G_STRUCT_OFFSET (PinPointPoint, bg),
+  G_STRUCT_OFFSET (PinPointPoint, text),
+  G_STRUCT_OFFSET (PinPointPoint, font),
+  G_STRUCT_OFFSET (PinPointPoint, notes_font),
+  G_STRUCT_OFFSET (PinPointPoint, notes_font_size),
+  G_STRUCT_OFFSET (PinPointPoint, text_color),
+  G_STRUCT_OFFSET (PinPointPoint, speaker_notes),
+  G_STRUCT_OFFSET (PinPointPoint, shading_color),
+  G_STRUCT_OFFSET (PinPointPoint, transition),
+  G_STRUCT_OFFSET (PinPointPoint, command),
+};
+
+#define PP_PINC_N_STRINGS G_N_ELEMENTS (pp_pinc_strings)
+
+typedef struct
+{
+  guint64 source_start;
+  guint64 source_end;
+  guint32 strings[PP_PINC_N_STRINGS];
+  gint32  bg_type;
+  gint32  bg_scale;
+  gint32  bg_position;
+  gint32  position;
+  gint32  text_align;
+  gint32  use_markup;
+  gint32  camera_framerate;
+  gint32  camera_width;
+  gint32  camera_height;
+  gint32  bg_width;
+  gint32  bg_height;
+  gfloat  duration;
+  gfloat  shading_opacity;
+  guint64 bg_size;    /* of the file bg_width and bg_height were read from */
+  gint64  bg_mtime;
+} PPPincPoint;
+
+/* fills in what identifies the source of a .pinc */
+static gboolean
+pp_pinc_source (PPPincHeader *header,
+                const char   *pinfile,
+                GMappedFile  *source)
+{
+  GStatBuf st;
+
+  if (g_stat (pinfile, &st) != 0)
+    return FALSE;
+
+  header->magic = PP_PINC_MAGIC;
+  header->version = PP_PINC_VERSION;
+  header->point_size = sizeof (PPPincPoint);
+  header->ignore_comments = pp_ignore_comments;
+  header->source_size = g_mapped_file_get_length (source);
+  header->source_mtime = st.st_mtime;
+  header->source_hash = pp_source_hash (g_mapped_file_get_contents (source),
+                                        g_mapped_file_get_length (source));
+  return TRUE;
+}
+
+static char *
+pp_pinc_path (const char *pinfile)
+{
+  return g_strconcat (pinfile, "c", NULL);
+}
+
+static void
+pp_pinc_put_point (PPPincPoint   *rec,
+                   PinPointPoint *point,
+                   GString       *strings,
+                   GHashTable    *offsets)
+{
+  GStatBuf st;
+  guint    i;
+
+  memset (rec, 0, sizeof (*rec));
+  for (i = 0; i < PP_PINC_N_STRINGS; i++)
+    {
+      const char *str = G_STRUCT_MEMBER (const char *, point,
+                                         pp_pinc_strings[i]);
+      gsize       offset;
+
+      if (!str)
+        continue;
+      offset = GPOINTER_TO_SIZE (g_hash_table_lookup (offsets, str));
+      if (!offset)
+        {
+          offset = strings->len;
+          g_string_append_len (strings, str, strlen (str) + 1);
+          g_hash_table_insert (offsets, (gpointer) str,
+                               GSIZE_TO_POINTER (offset));
+        }
+      rec->strings[i] = offset;
+    }
+
+  rec->source_start = point->source_start;
+  rec->source_end = point->source_end;
+  rec->bg_type = point->bg_type;
+  rec->bg_scale = point->bg_scale;
+  rec->bg_position = point->bg_position;
+  rec->position = point->position;
+  rec->text_align = point->text_align;
+  rec->use_markup = point->use_markup;
+  rec->camera_framerate = point->camera_framerate;
+  rec->camera_width = point->camera_resolution.width;
+  rec->camera_height = point->camera_resolution.height;
+  rec->bg_width = point->bg_width;
+  rec->bg_height = point->bg_height;
+  rec->duration = point->duration;
+  rec->shading_opacity = point->shading_opacity;
+
+  if (point->bg_width > 0 && g_stat (point->bg_file, &st) == 0)
+    {
+      rec->bg_size = st.st_size;
+      rec->bg_mtime = st.st_mtime;
+    }
+  else
+    {
+      rec->bg_width = rec->bg_height = 0;
+    }
+}
+
+static gboolean
+pp_pinc_get_point (PinPointPoint     *point,
+                   const PPPincPoint *rec,
+                   const char        *strings,
+                   gsize              strings_size)
+{
+  guint i;
+
+  for (i = 0; i < PP_PINC_N_STRINGS; i++)
+    {
+      if (rec->strings[i] >= strings_size)
+        return FALSE;
+      G_STRUCT_MEMBER (const char *, point, pp_pinc_strings[i]) =
+        rec->strings[i] ? strings + rec->strings[i] : NULL;
+    }
+  /* a stale or broken file is parsed instead, nothing that ends in a switch
+   * or indexes an array goes through unchecked */
+  if (rec->bg_type < PP_BG_NONE || rec->bg_type > PP_BG_SVG ||
+      rec->bg_scale < PP_BG_UNSCALED || rec->bg_scale > PP_BG_STRETCH ||
+      rec->bg_position < CLUTTER_GRAVITY_NONE ||
+      rec->bg_position > CLUTTER_GRAVITY_CENTER ||
+      rec->position < CLUTTER_GRAVITY_NONE ||
+      rec->position > CLUTTER_GRAVITY_CENTER ||
+      (rec->text_align != PP_TEXT_LEFT &&
+       rec->text_align != PP_TEXT_CENTER &&
+       rec->text_align != PP_TEXT_RIGHT) ||
+      (rec->use_markup != FALSE && rec->use_markup != TRUE) ||
+      rec->camera_framerate < 0 ||
+      rec->camera_width < 0 || rec->camera_height < 0 ||
+      rec->source_start > rec->source_end ||
+      rec->duration - rec->duration != 0.0 ||        /* nan or infinite */
+      rec->shading_opacity - rec->shading_opacity != 0.0)
+    return FALSE;
+
+  point->source_start = rec->source_start;
+  point->source_end = rec->source_end;
+  point->bg_type = rec->bg_type;
+  point->bg_scale = rec->bg_scale;
+  point->bg_position = rec->bg_position;
+  point->position = rec->position;
+  point->text_align = rec->text_align;
+  point->use_markup = rec->use_markup;
+  point->camera_framerate = rec->camera_framerate;
+  point->camera_resolution.width = rec->camera_width;
+  point->camera_resolution.height = rec->camera_height;
+  point->duration = rec->duration;
+  point->shading_opacity = rec->shading_opacity;
+  return TRUE;
+}
+
+/* the background sizes probed by --compile, unless the file changed since */
+static void
+pp_pinc_get_bg_size (PinPointPoint     *point,
+                     const PPPincPoint *rec)
+{
+  GStatBuf st;
+
+  if (rec->bg_width > 0 && g_stat (point->bg_file, &st) == 0 &&
+      (guint64) st.st_size == rec->bg_size &&
+      (gint64) st.st_mtime == rec->bg_mtime)
+    {
+      point->bg_width = rec->bg_width;
+      point->bg_height = rec->bg_height;
+    }
+}
+
+/* parses the presentation and writes its .pinc, probing the size of the
+ * backgrounds on the way, for --compile */
+static gboolean
+pp_pinc_write (const char  *pinfile,
+               GMappedFile *source)
+{
+  PinPointRenderer renderer = { .make_point = pp_null_make_point };
+  PPPincHeader     header = { 0, };
+  PPPincPoint      rec;
+  GString         *out;
+  GString         *strings;
+  GHashTable      *offsets;
+  GError          *error = NULL;
+  PinPointPoint   *point;
+  char            *path;
+  gboolean         ok;
+  gint             i;
+
+  if (!pp_pinc_source (&header, pinfile, source))
+    {
+      g_print ("failed to stat %s\n", pinfile);
+      return FALSE;
+    }
+
+  pp_parse_slides (&renderer, g_mapped_file_get_contents (source),
+                   g_mapped_file_get_length (source));
+
+  for (i = 0; (point = pp_slide_nth (i)); i++)
+    if (point->bg_type == PP_BG_IMAGE || point->bg_type == PP_BG_SVG)
+      gdk_pixbuf_get_file_info (point->bg_file,
+                                &point->bg_width, &point->bg_height);
+
+  /* offset 0 stands for NULL */
+  strings = g_string_new ("");
+  g_string_append_c (strings, '\0');
+  offsets = g_hash_table_new (g_str_hash, g_str_equal);
+
+  header.n_points = pp_slides->len + 1;
+  header.header_end = pp_presentation->header_end;
+  out = g_string_new ("");
+  g_string_append_len (out, (const char *) &header, sizeof (header));
+  pp_pinc_put_point (&rec, point_defaults, strings, offsets);
+  g_string_append_len (out, (const char *) &rec, sizeof (rec));
+  for (i = 0; (point = pp_slide_nth (i)); i++)
+    {
+      pp_pinc_put_point (&rec, point, strings, offsets);
+      g_string_append_len (out, (const char *) &rec, sizeof (rec));
+    }
+  g_string_append_len (out, strings->str, strings->len);
+  ((PPPincHeader *) out->str)->strings_size = strings->len;
+
+  path = pp_pinc_path (pinfile);
+  ok = g_file_set_contents (path, out->str, out->len, &error);
+  if (ok)
+    g_print ("compiled %u slides into %s (%" G_GSIZE_FORMAT " bytes)\n",
+             pp_slides->len, path, out->len);
+  else
+    {
+      g_print ("failed to write %s: %s\n", path, error->message);
+      g_error_free (error);
+    }
+
+  g_free (path);
+  g_hash_table_destroy (offsets);
+  g_string_free (strings, TRUE);
+  g_string_free (out, TRUE);
+  return ok;
+}
+
+/* makes the slides from the .pinc of pinfile if there is an up to date one,
+ * returns FALSE when the source has to be parsed */
+static gboolean
+pp_pinc_load (PinPointRenderer *renderer,
+              const char       *pinfile,
+              GMappedFile      *source)
+{
+  const PPPincHeader   *header;
+  const PPPincPoint    *recs;
+  const char           *strings;
+  PPPincHeader          expected = { 0, };
+  GMappedFile          *pinc;
+  PinPointPresentation *pres;
+  PinPointPoint        *point;
+  char                 *path;
+  gsize                 length;
+  guint                 i;
+
+  /* PDFs default to another stage color than the .pinc was compiled with */
+  if (pp_output_filename)
+    return FALSE;
+
+  path = pp_pinc_path (pinfile);
+  pinc = g_mapped_file_new (path, FALSE, NULL);
+  g_free (path);
+  if (!pinc)
+    return FALSE;
+
+  header = (const PPPincHeader *) g_mapped_file_get_contents (pinc);
+  length = g_mapped_file_get_length (pinc);
+  if (length < sizeof (*header) ||
+      header->magic != PP_PINC_MAGIC ||
+      header->version != PP_PINC_VERSION ||
+      header->point_size != sizeof (PPPincPoint) ||
+      header->n_points < 1 ||
+      header->n_points > (length - sizeof (*header)) / sizeof (PPPincPoint) ||
+      header->strings_size < 1 ||
+      length != sizeof (*header) + header->n_points * sizeof (PPPincPoint) +
+                header->strings_size ||
+      !pp_pinc_source (&expected, pinfile, source) ||
+      header->ignore_comments != expected.ignore_comments ||
+      header->source_size != expected.source_size ||
+      header->source_mtime != expected.source_mtime ||
+      header->source_hash != expected.source_hash ||
+      header->header_end > header->source_size)
+    {
+      g_mapped_file_unref (pinc);
+      return FALSE;
+    }
+
+  recs = (const PPPincPoint *) (header + 1);
+  strings = (const char *) (recs + header->n_points);
+  if (strings[header->strings_size - 1] != '\0')
+    {
+      g_mapped_file_unref (pinc);
+      return FALSE;
+    }
+
+  pres = pp_presentation_new (0);
+  pres->arena->pinc = pinc;
+  if (!pp_pinc_get_point (&pres->defaults, &recs[0], strings,
+                          header->strings_size))
+    goto broken;
+  pp_resolve_bg_file (pres, &pres->defaults);
+
+  for (i = 1; i < header->n_points; i++)
+    {
+      point = pin_point_new (pres);
+      g_ptr_array_add (pres->slides, point);
+      if (!pp_pinc_get_point (point, &recs[i], strings, header->strings_size))
+        goto broken;
+      pp_resolve_bg_file (pres, point);
+      pp_pinc_get_bg_size (point, &recs[i]);
+      pp_resolve_style (point);
+    }
+
+  /* only make the points once all of them turned out to be fine */
+  for (i = 0; i < pres->slides->len; i++)
+    {
+      point = g_ptr_array_index (pres->slides, i);
+      if (renderer->allocate_data)
+        point->data = renderer->allocate_data (renderer);
+      renderer->make_point (renderer, point);
+    }
+
+  pres->header_end = header->header_end;
+  pres->source_hash = expected.source_hash;
+  pres->source_len = g_mapped_file_get_length (source);
+  pres->source = g_strndup (pres->source_len ?
+                              g_mapped_file_get_contents (source) : "",
+                            pres->source_len);
+  pp_presentation_free (renderer, pp_presentation_swap (pres));
+  pp_slide_no = pp_slides->len ? 0 : -1;
+  return TRUE;
+
+broken:
+  g_warning ("ignoring the broken precompiled presentation of %s", pinfile);
+  pp_presentation_free (renderer, pres);
+  return FALSE;
+}
+
+/*
+ * Decoded backgrounds
+ *
+ * The renderers keep background pixels as PPPixels, premultiplied and laid
+ * out like a cairo ARGB32 surface. Decoding them is most of the startup time
+ * of a deck full of photos, so they are also kept in $XDG_CACHE_HOME/pinpoint
+ * with a file per decode, named after the hash of the image file, the size
+ * it was decoded to and the bg_scale modes it was decoded for. A cache file
+ * is a PPCacheHeader followed by the pixels and is mapped as it is.
+ *
+ * Hashing an image is only needed when it changed: a PPCacheStamp file,
+ * named after the hash of its path, remembers the hash for the size and
+ * mtime it had. Loading a cache file touches it. The directory is counted
+ * once, on the first save, and the least recently used files are removed
+ * when the saves since take it past PP_CACHE_LIMIT.
+ */
+
+#define PP_CACHE_MAGIC   0x47424950 /* "PIBG" on little endian */
+#define PP_CACHE_VERSION 2 /* 2: opaque set for an alpha channel of 0xff */
+#define PP_CACHE_LIMIT   (G_GUINT64_CONSTANT (512) << 20) /* bytes */
+
+typedef struct
+{
+  guint32 magic;
+  guint32 version;
+  gint32  width;
+  gint32  height;
+  gint32  stride;
+  guint32 opaque;
+  guint32 pad[2];   /* keeps the pixels 16 byte aligned */
+} PPCacheHeader;
+
+typedef struct
+{
+  guint64 size;
+  gint64  mtime;
+  guint64 hash;     /* of the contents */
+} PPCacheStamp;
+
+/* This function is adapted from Gtk's gdk_cairo_set_source_pixbuf() you can
+ * find in gdk/gdkcairo.c.
+ * Copyright (C) Red Had, Inc.
+ * LGPLv2+ */
+void
+pp_pixels_from_pixbuf (PPPixels  *pixels,
+                       GdkPixbuf *pixbuf)
+{
+  int     width         = gdk_pixbuf_get_width (pixbuf);
+  int     height        = gdk_pixbuf_get_height (pixbuf);
+  guchar *gdk_pixels    = gdk_pixbuf_get_pixels (pixbuf);
+  int     gdk_rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+  int     n_channels    = gdk_pixbuf_get_n_channels (pixbuf);
+  guchar *pixels_row;
+  guint   alpha         = 0xff;
+  int     j;
+
+  pixels->width = width;
+  pixels->height = height;
+  pixels->stride = width * 4;
+  pixels->opaque = n_channels == 3;
+  pixels->data = g_malloc ((gsize) height * pixels->stride);
+  pixels->mapped = NULL;
+
+  pixels_row = pixels->data;
+  for (j = height; j; j--)
+    {
+      guchar *p = gdk_pixels;
+      guchar *q = pixels_row;
+
+      if (n_channels == 3)
+        {
+          guchar *end = p + 3 * width;
+
+          while (p < end)
+            {
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+              q[0] = p[2];
+              q[1] = p[1];
+              q[2] = p[0];
+              q[3] = 0xff;
+#else
+              q[0] = 0xff;
+              q[1] = p[0];
+              q[2] = p[1];
+              q[3] = p[2];
+#endif
+              p += 3;
+              q += 4;
+            }
+        }
+      else
+        {
+          guchar *end = p + 4 * width;
+          guint t1,t2,t3;
+
+#define MULT(d,c,a,t) G_STMT_START { t = c * a + 0x7f; d = ((t >> 8) + t) >> 8; } G_STMT_END
+
+          while (p < end)
+            {
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+              MULT(q[0], p[2], p[3], t1);
+              MULT(q[1], p[1], p[3], t2);
+              MULT(q[2], p[0], p[3], t3);
+              q[3] = p[3];
+#else
+              q[0] = p[3];
+              MULT(q[1], p[0], p[3], t1);
+              MULT(q[2], p[1], p[3], t2);
+              MULT(q[3], p[2], p[3], t3);
+#endif
+
+              alpha &= p[3];
+              p += 4;
+              q += 4;
+            }
+
+#undef MULT
+        }
+
+      gdk_pixels += gdk_rowstride;
+      pixels_row += pixels->stride;
+    }
+
+  /* a png with an alpha channel it does not use is kept without */
+  if (alpha == 0xff)
+    pixels->opaque = TRUE;
+}
+
+void
+pp_pixels_clear (PPPixels *pixels)
+{
+  if (pixels->mapped)
+    g_mapped_file_unref (pixels->mapped);
+  else
+    g_free (pixels->data);
+  pixels->data = NULL;
+  pixels->mapped = NULL;
+}
+
+static char *
+pp_cache_dir (void)
+{
+  return g_build_filename (g_get_user_cache_dir (), "pinpoint", NULL);
+}
+
+/* FALSE if file cannot be read */
+static gboolean
+pp_cache_file_hash (const char *file,
+                    guint64    *hash)
+{
+  PPCacheStamp  stamp, *stored = NULL;
+  GStatBuf      st;
+  GMappedFile  *mapped;
+  char         *abs, *name, *dir, *path;
+  gsize         len;
+
+  if (g_stat (file, &st) != 0)
+    return FALSE;
+
+  if (g_path_is_absolute (file))
+    abs = g_strdup (file);
+  else
+    {
+      char *cwd = g_get_current_dir ();
+
+      abs = g_build_filename (cwd, file, NULL);
+      g_free (cwd);
+    }
+  name = g_strdup_printf ("stamp-%016" G_GINT64_MODIFIER "x",
+                          pp_source_hash (abs, strlen (abs)));
+  dir = pp_cache_dir ();
+  path = g_build_filename (dir, name, NULL);
+  g_free (abs);
+  g_free (name);
+
+  stamp.size = st.st_size;
+  stamp.mtime = st.st_mtime;
+  if (g_file_get_contents (path, (char **) &stored, &len, NULL) &&
+      len == sizeof (stamp) &&
+      stored->size == stamp.size && stored->mtime == stamp.mtime)
+    {
+      *hash = stored->hash;
+      g_free (stored);
+      g_free (path);
+      g_free (dir);
+      return TRUE;
+    }
+  g_free (stored);
+
+  mapped = g_mapped_file_new (file, FALSE, NULL);
+  if (!mapped)
+    {
+      g_free (path);
+      g_free (dir);
+      return FALSE;
+    }
+  stamp.hash = pp_source_hash (g_mapped_file_get_contents (mapped),
+                               g_mapped_file_get_length (mapped));
+  g_mapped_file_unref (mapped);
+
+  g_mkdir_with_parents (dir, 0700);
+  g_file_set_contents (path, (char *) &stamp, sizeof (stamp), NULL);
+  *hash = stamp.hash;
+  g_free (path);
+  g_free (dir);
+  return TRUE;
+}
+
+/* NULL if file cannot be read */
+char *
+pp_cache_path (const char *file,
+               guint       modes,
+               gint        width,
+               gint        height)
+{
+  guint64      hash;
+  char        *name, *dir, *path;
+
+  if (!pp_cache_file_hash (file, &hash))
+    return NULL;
+
+  name = g_strdup_printf ("%016" G_GINT64_MODIFIER "x-%dx%d-%x",
+                          hash, width, height, modes);
+  dir = pp_cache_dir ();
+  path = g_build_filename (dir, name, NULL);
+  g_free (name);
+  g_free (dir);
+  return path;
+}
+
+gboolean
+pp_cache_load (const char *path,
+               PPPixels   *pixels)
+{
+  GMappedFile   *mapped;
+  PPCacheHeader *header;
+
+  mapped = g_mapped_file_new (path, FALSE, NULL);
+  if (!mapped)
+    return FALSE;
+
+  header = (PPCacheHeader *) g_mapped_file_get_contents (mapped);
+  if (g_mapped_file_get_length (mapped) < sizeof (PPCacheHeader) ||
+      header->magic != PP_CACHE_MAGIC ||
+      header->version != PP_CACHE_VERSION ||
+      header->width < 1 || header->height < 1 ||
+      header->stride < header->width * 4 ||
+      g_mapped_file_get_length (mapped) !=
+        sizeof (PPCacheHeader) + (gsize) header->stride * header->height)
+    {
+      g_mapped_file_unref (mapped);
+      return FALSE;
+    }
+
+  /* its mtime is when it was last used, for pp_cache_trim () */
+  g_utime (path, NULL);
+
+  pixels->data = (guchar *) (header + 1);
+  pixels->width = header->width;
+  pixels->height = header->height;
+  pixels->stride = header->stride;
+  pixels->opaque = header->opaque;
+  pixels->mapped = mapped;
+  return TRUE;
+}
+
+typedef struct
+{
+  char    *path;
+  guint64  size;
+  gint64   mtime;
+} PPCacheEntry;
+
+static gint
+pp_cache_entry_compare (gconstpointer a,
+                        gconstpointer b)
+{
+  const PPCacheEntry *ea = a, *eb = b;
+
+  return ea->mtime < eb->mtime ? -1 : ea->mtime > eb->mtime;
+}
+
+/* bytes in the cache directory, counted by the first pp_cache_save () and
+ * kept up to date by the others */
+static GMutex   pp_cache_lock;
+static gboolean pp_cache_counted = FALSE;
+static guint64  pp_cache_size = 0;
+
+/* counts the cache, removing the least recently used files down to three
+ * quarters of PP_CACHE_LIMIT when it is over that. Called with
+ * pp_cache_lock held */
+static void
+pp_cache_trim (const char *dir)
+{
+  GDir          *gdir;
+  GArray        *entries;
+  const char    *name;
+  guint64        total = 0;
+  guint          i;
+
+  gdir = g_dir_open (dir, 0, NULL);
+  if (!gdir)
+    return;
+
+  entries = g_array_new (FALSE, FALSE, sizeof (PPCacheEntry));
+  while ((name = g_dir_read_name (gdir)))
+    {
+      PPCacheEntry entry;
+      GStatBuf     st;
+
+      entry.path = g_build_filename (dir, name, NULL);
+      if (g_stat (entry.path, &st) != 0 || !S_ISREG (st.st_mode))
+        {
+          g_free (entry.path);
+          continue;
+        }
+      entry.size = st.st_size;
+      entry.mtime = st.st_mtime;
+      total += entry.size;
+      g_array_append_val (entries, entry);
+    }
+  g_dir_close (gdir);
+
+  if (total > PP_CACHE_LIMIT)
+    g_array_sort (entries, pp_cache_entry_compare);
+  for (i = 0; i < entries->len; i++)
+    {
+      PPCacheEntry *entry = &g_array_index (entries, PPCacheEntry, i);
+
+      if (total > PP_CACHE_LIMIT / 4 * 3 && g_unlink (entry->path) == 0)
+        total -= entry->size;
+      g_free (entry->path);
+    }
+  g_array_free (entries, TRUE);
+
+  pp_cache_size = total;
+  pp_cache_counted = TRUE;
+}
+
+/* can be called from any thread, like pp_cache_path () and pp_cache_load () */
+void
+pp_cache_save (const char     *path,
+               const PPPixels *pixels)
+{
+  PPCacheHeader  header = { 0, };
+  gsize          size = (gsize) pixels->stride * pixels->height;
+  char          *contents, *dir;
+  GError        *error = NULL;
+  gboolean       saved;
+
+  header.magic = PP_CACHE_MAGIC;
+  header.version = PP_CACHE_VERSION;
+  header.width = pixels->width;
+  header.height = pixels->height;
+  header.stride = pixels->stride;
+  header.opaque = pixels->opaque;
+
+  dir = g_path_get_dirname (path);
+  g_mkdir_with_parents (dir, 0700);
+
+  contents = g_malloc (sizeof (header) + size);
+  memcpy (contents, &header, sizeof (header));
+  memcpy (contents + sizeof (header), pixels->data, size);
+  saved = g_file_set_contents (path, contents, sizeof (header) + size, &error);
+  if (!saved)
+    {
+      g_debug ("could not cache %s: %s", path, error->message);
+      g_clear_error (&error);
+    }
+  g_free (contents);
+
+  g_mutex_lock (&pp_cache_lock);
+  if (saved)
+    pp_cache_size += sizeof (header) + size;
+  if (!pp_cache_counted || pp_cache_size > PP_CACHE_LIMIT)
+    pp_cache_trim (dir);
+  g_mutex_unlock (&pp_cache_lock);
+  g_free (dir);
 }
@@ -29,6 +29,7 @@
 #endif
 
 #include <clutter/clutter.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
 
 typedef struct _PinPointPoint    PinPointPoint;
 typedef struct _PinPointRenderer PinPointRenderer;
@@ -76,7 +77,6 @@ struct _PinPointRenderer
   void *    (*allocate_data) (PinPointRenderer *renderer);
   void      (*free_data)     (PinPointRenderer *renderer,
                               void             *datap);
-  char *      source;
 };
 
 struct _PinPointPoint
@@ -84,6 +84,8 @@ struct _PinPointPoint
   const char        *stage_color;
 
   const gchar       *bg;
+  const gchar       *bg_file;       /* bg resolved against the directory
+                                       of the presentation */
   PPBackgroundType   bg_type;
   PPBackgroundScale  bg_scale;
   ClutterGravity     bg_position;
@@ -114,7 +116,22 @@ struct _PinPointPoint
   gint              camera_framerate;
   PPResolution      camera_resolution;
 
-  void              *data;            /* the renderer can attach data here */
+  /* stage_color, text_color, shading_color, the bg color (for PP_BG_COLOR
+   * only) and font as resolved by the parser, see pp_style_color () */
+  const ClutterColor         *stage_rgba;
+  const ClutterColor         *text_rgba;
+  const ClutterColor         *shading_rgba;
+  const ClutterColor         *bg_rgba;
+  const PangoFontDescription *font_desc;
+
+  gint              bg_width;         /* size of an image or svg bg, only */
+  gint              bg_height;        /* known for compiled presentations */
+
+  gsize             source_start;     /* byte span of the slide in the source, */
+  gsize             source_end;       /* used to keep unchanged slides on reload */
+
+  void              *data;            /* the renderer can attach data here,
+                                         must stay the last member */
 };
 
 extern char     *pp_output_filename;
@@ -123,14 +140,67 @@ extern gboolean  pp_maximized;
 extern gboolean  pp_speakermode;
 extern gboolean  pp_rehearse;
 extern char     *pp_camera_device;
-
-extern GList         *pp_slides;  /* list of slide text */
-extern GList         *pp_slidep;  /* current slide */
+extern gint      pp_texture_budget;
+extern gint      pp_texture_window;
+extern gboolean  pp_rgb565;
+extern gint      pp_pdf_jobs;
+extern gint      pp_pdf_dpi;
+extern gint      pp_pdf_jpeg_quality;
+extern gboolean  pp_benchmark_frames;
+
+extern GPtrArray     *pp_slides;   /* the slides, in presentation order */
+extern gint           pp_slide_no; /* index of the current slide */
 extern GFile         *pp_basedir;
 extern PinPointPoint *point_defaults;
 
-void     pp_parse_slides  (PinPointRenderer *renderer,
-                           const char       *slide_src);
+PinPointPoint *pp_slide_nth (gint slide_no);
+
+const ClutterColor         *pp_style_color (const char *string);
+const PangoFontDescription *pp_style_font  (const char *string);
+
+guint    pp_parse_slides  (PinPointRenderer *renderer,
+                           const char       *slide_src,
+                           gsize             length);
+void     pp_stream_slides (PinPointRenderer *renderer,
+                           GMappedFile      *mapped);
+void     pp_stream_finish (void);
+
+/* called on the main loop once the slides are in place, changed is FALSE
+ * when the source turned out to be what is shown already */
+typedef void (*PPParseDone) (PinPointRenderer *renderer,
+                             gboolean          changed,
+                             guint             made,
+                             gpointer          data);
+
+void     pp_parse_slides_async (PinPointRenderer *renderer,
+                                GMappedFile      *mapped,
+                                PPParseDone       done,
+                                gpointer          data);
+
+/* decoded background pixels, premultiplied and laid out like a cairo
+ * CAIRO_FORMAT_ARGB32 surface */
+typedef struct
+{
+  guchar      *data;
+  gint         width;
+  gint         height;
+  gint         stride;
+  gboolean     opaque;   /* alpha is 0xff throughout */
+  GMappedFile *mapped;   /* owns data when it comes from the cache */
+} PPPixels;
+
+void     pp_pixels_from_pixbuf (PPPixels       *pixels,
+                                GdkPixbuf      *pixbuf);
+void     pp_pixels_clear       (PPPixels       *pixels);
+
+char    *pp_cache_path         (const char     *file,
+                                guint           modes,
+                                gint            width,
+                                gint            height);
+gboolean pp_cache_load         (const char     *path,
+                                PPPixels       *pixels);
+void     pp_cache_save         (const char     *path,
+                                const PPPixels *pixels);
 
 void
 pp_get_padding (float  stage_width,
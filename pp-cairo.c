@@ -27,6 +27,7 @@
 #include <cairo.h>
 #include <cairo-pdf.h>
 #include <gdk-pixbuf/gdk-pixbuf.h>
+#include <glib/gstdio.h>
 #include <pango/pango.h>
 #include <pango/pangocairo.h>
 #ifdef HAVE_RSVG
@@ -50,7 +51,16 @@ typedef struct _CairoRenderer
                                    svg backgrounds as we want to only
                                    include one instance of the image
                                    when using it in several slides */
-  cairo_surface_t *surface;
+  GHashTable      *assets;      /* path -> the key of its content in
+                                   surfaces and svgs, the path of the
+                                   first file with it */
+  GHashTable      *sizes;       /* size -> CairoAssets of that size */
+  GMutex           assets_lock;
+  GMutex           lock;        /* of surfaces and svgs, the pages are
+                                   drawn on several threads */
+  GCond            loaded;      /* one of them was filled */
+  GMutex           svg_lock;    /* an RsvgHandle renders on one at once */
+  cairo_surface_t *surface;     /* the pdf, NULL when drawing elsewhere */
   cairo_t         *ctx;
   double           width;
   double           height;
@@ -60,6 +70,14 @@ typedef struct
 {
 } CairoPointData;
 
+typedef struct
+{
+  char    *path;
+  guint64  dev;
+  guint64  ino;
+  char    *hash;   /* of the contents, once a file of the same size shows up */
+} CairoAsset;
+
 static void
 _destroy_surface (gpointer data)
 {
@@ -68,6 +86,31 @@ _destroy_surface (gpointer data)
   cairo_surface_destroy (surface);
 }
 
+static void
+_destroy_asset (gpointer data)
+{
+  CairoAsset *asset = data;
+
+  g_free (asset->path);
+  g_free (asset->hash);
+  g_slice_free (CairoAsset, asset);
+}
+
+static void
+_destroy_assets (gpointer data)
+{
+  g_ptr_array_free (data, TRUE);
+}
+
+#ifdef HAVE_RSVG
+static void
+_destroy_svg (gpointer data)
+{
+  if (data)
+    g_object_unref (data);
+}
+#endif
+
 #define A4_LS_WIDTH   841.88976378
 #define A4_LS_HEIGHT  595.275590551
 
@@ -87,126 +130,339 @@ cairo_renderer_init (PinPointRenderer *pp_renderer,
   renderer->path = g_strdup (pinpoint_file);
 
   renderer->ctx = cairo_create (renderer->surface);
+  renderer->assets = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                            g_free, g_free);
+  renderer->sizes = g_hash_table_new_full (g_int64_hash, g_int64_equal,
+                                           g_free, _destroy_assets);
   renderer->surfaces = g_hash_table_new_full (g_str_hash, g_str_equal,
                                               g_free, _destroy_surface);
+#ifdef HAVE_RSVG
   renderer->svgs = g_hash_table_new_full (g_str_hash, g_str_equal,
-                                          NULL,
-                                          g_object_unref);
+                                          g_free,
+                                          _destroy_svg);
+#else
+  renderer->svgs = g_hash_table_new (g_str_hash, g_str_equal);
+#endif
+}
+
+static void
+_cairo_pixels_free (void *data)
+{
+  PPPixels *pixels = data;
+
+  pp_pixels_clear (pixels);
+  g_slice_free (PPPixels, pixels);
 }
 
-/* This function is adapted from Gtk's gdk_cairo_set_source_pixbuf() you can
- * find in gdk/gdkcairo.c.
- * Copyright (C) Red Had, Inc.
- * LGPLv2+ */
+/* takes over the pixels */
 static cairo_surface_t *
-_cairo_new_surface_from_pixbuf (const GdkPixbuf *pixbuf)
+_cairo_new_surface_from_pixels (PPPixels *pixels)
 {
-  int              width         = gdk_pixbuf_get_width (pixbuf);
-  int              height        = gdk_pixbuf_get_height (pixbuf);
-  guchar          *gdk_pixels    = gdk_pixbuf_get_pixels (pixbuf);
-  int              gdk_rowstride = gdk_pixbuf_get_rowstride (pixbuf);
-  int              n_channels    = gdk_pixbuf_get_n_channels (pixbuf);
-  int              cairo_stride;
-  guchar          *cairo_pixels;
+  static const cairo_user_data_key_t  key;
+  cairo_surface_t                    *surface;
+  PPPixels                           *owned;
+
+  owned = g_slice_dup (PPPixels, pixels);
+  surface = cairo_image_surface_create_for_data (owned->data,
+                                                 owned->opaque ?
+                                                   CAIRO_FORMAT_RGB24 :
+                                                   CAIRO_FORMAT_ARGB32,
+                                                 owned->width, owned->height,
+                                                 owned->stride);
+  cairo_surface_set_user_data (surface, &key, owned, _cairo_pixels_free);
 
-  cairo_format_t   format;
-  cairo_surface_t *surface;
-  static const     cairo_user_data_key_t key;
-  int              j;
+  return surface;
+}
 
-  if (n_channels == 3)
-    format = CAIRO_FORMAT_RGB24;
-  else
-    format = CAIRO_FORMAT_ARGB32;
+static cairo_surface_t *
+_cairo_new_surface_from_pixbuf (GdkPixbuf *pixbuf)
+{
+  PPPixels pixels;
 
-  cairo_stride = cairo_format_stride_for_width (format, width);
-  cairo_pixels = g_malloc (height * cairo_stride);
-  surface = cairo_image_surface_create_for_data ((unsigned char *)cairo_pixels,
-                                                 format,
-                                                 width, height, cairo_stride);
+  pp_pixels_from_pixbuf (&pixels, pixbuf);
+  return _cairo_new_surface_from_pixels (&pixels);
+}
+
+static char *
+_cairo_asset_hash (const char *file)
+{
+  GMappedFile *mapped;
+  char        *hash;
+
+  mapped = g_mapped_file_new (file, FALSE, NULL);
+  if (!mapped)
+    return NULL;
+  hash = g_compute_checksum_for_data (G_CHECKSUM_SHA1,
+                                      (const guchar *)
+                                        g_mapped_file_get_contents (mapped),
+                                      g_mapped_file_get_length (mapped));
+  g_mapped_file_unref (mapped);
+
+  return hash;
+}
 
-  cairo_surface_set_user_data (surface, &key,
-			       cairo_pixels, (cairo_destroy_func_t)g_free);
+/* the key of file in surfaces and svgs, the same for copies of a file and
+ * links to it, so it is decoded and put into the pdf once. Only files of
+ * the same size as one seen before are read to compare the contents */
+static const char *
+_cairo_asset_key (CairoRenderer *renderer,
+                  const char    *file)
+{
+  const char *key;
+  GStatBuf    st;
 
-  for (j = height; j; j--)
+  g_mutex_lock (&renderer->assets_lock);
+  key = g_hash_table_lookup (renderer->assets, file);
+  if (!key)
     {
-      guchar *p = gdk_pixels;
-      guchar *q = cairo_pixels;
-
-      if (n_channels == 3)
-	      {
-          guchar *end = p + 3 * width;
+      key = file;
+      if (g_stat (file, &st) == 0)
+        {
+          gint64     size = st.st_size;
+          GPtrArray *same = g_hash_table_lookup (renderer->sizes, &size);
+          char      *hash = NULL;
+          guint      i;
 
-          while (p < end)
+          if (!same)
             {
-#if G_BYTE_ORDER == G_LITTLE_ENDIAN
-              q[0] = p[2];
-              q[1] = p[1];
-              q[2] = p[0];
-#else
-              q[1] = p[0];
-              q[2] = p[1];
-              q[3] = p[2];
-#endif
-              p += 3;
-              q += 4;
-            }
-	      }
-      else
-        {
-          guchar *end = p + 4 * width;
-          guint t1,t2,t3;
+              gint64 *size_key = g_new (gint64, 1);
 
-#define MULT(d,c,a,t) G_STMT_START { t = c * a + 0x7f; d = ((t >> 8) + t) >> 8; } G_STMT_END
+              *size_key = size;
+              same = g_ptr_array_new_with_free_func (_destroy_asset);
+              g_hash_table_insert (renderer->sizes, size_key, same);
+            }
 
-          while (p < end)
+          for (i = 0; i < same->len && key == file; i++)
             {
-#if G_BYTE_ORDER == G_LITTLE_ENDIAN
-              MULT(q[0], p[2], p[3], t1);
-              MULT(q[1], p[1], p[3], t2);
-              MULT(q[2], p[0], p[3], t3);
-              q[3] = p[3];
-#else
-              q[0] = p[3];
-              MULT(q[1], p[0], p[3], t1);
-              MULT(q[2], p[1], p[3], t2);
-              MULT(q[3], p[2], p[3], t3);
-#endif
-
-              p += 4;
-              q += 4;
+              CairoAsset *asset = g_ptr_array_index (same, i);
+
+              if (asset->dev == (guint64) st.st_dev &&
+                  asset->ino == (guint64) st.st_ino)
+                {
+                  key = asset->path;
+                  break;
+                }
+
+              if (!asset->hash)
+                asset->hash = _cairo_asset_hash (asset->path);
+              if (!hash)
+                hash = _cairo_asset_hash (file);
+              if (hash && !g_strcmp0 (hash, asset->hash))
+                key = asset->path;
             }
 
-#undef MULT
+          if (key == file)
+            {
+              CairoAsset *asset = g_slice_new (CairoAsset);
+
+              asset->path = g_strdup (file);
+              asset->dev = st.st_dev;
+              asset->ino = st.st_ino;
+              asset->hash = hash;
+              hash = NULL;
+              g_ptr_array_add (same, asset);
+            }
+          g_free (hash);
         }
 
-      gdk_pixels += gdk_rowstride;
-      cairo_pixels += cairo_stride;
+      key = g_strdup (key);
+      g_hash_table_insert (renderer->assets, g_strdup (file), (char *) key);
+    }
+  g_mutex_unlock (&renderer->assets_lock);
+
+  return key;
+}
+
+/* returns what cache has for file, or NULL when the caller is to load it
+ * and hand it to _cairo_cache_fill (), the other pages needing it wait */
+static gpointer
+_cairo_cache_claim (CairoRenderer *renderer,
+                    GHashTable    *cache,
+                    const char    *file)
+{
+  gpointer value = NULL;
+
+  g_mutex_lock (&renderer->lock);
+  while (g_hash_table_lookup_extended (cache, file, NULL, &value) && !value)
+    g_cond_wait (&renderer->loaded, &renderer->lock);
+  if (!value)
+    g_hash_table_insert (cache, g_strdup (file), NULL); /* loading */
+  g_mutex_unlock (&renderer->lock);
+
+  return value;
+}
+
+/* value is NULL when loading failed, the next page tries again */
+static void
+_cairo_cache_fill (CairoRenderer *renderer,
+                   GHashTable    *cache,
+                   const char    *file,
+                   gpointer       value)
+{
+  g_mutex_lock (&renderer->lock);
+  if (value)
+    g_hash_table_insert (cache, g_strdup (file), value);
+  else
+    g_hash_table_remove (cache, file);
+  g_cond_broadcast (&renderer->loaded);
+  g_mutex_unlock (&renderer->lock);
+}
+
+/* how much of file, of the content key, the pages need at --pdf-dpi, the
+ * largest scale any slide shows it at */
+static float
+_cairo_image_scale (CairoRenderer *renderer,
+                    const char    *key,
+                    gint           width,
+                    gint           height)
+{
+  PinPointPoint *point;
+  float          scale = 0.0;
+  gint           i;
+
+  for (i = 0; (point = pp_slide_nth (i)); i++)
+    {
+      float bg_x, bg_y, bg_scale_x, bg_scale_y;
+
+      if (point->bg_type != PP_BG_IMAGE || !point->bg_file ||
+          g_strcmp0 (_cairo_asset_key (renderer, point->bg_file), key))
+        continue;
+
+      pp_get_background_position_scale (point,
+                                        renderer->width, renderer->height,
+                                        width, height,
+                                        &bg_x, &bg_y,
+                                        &bg_scale_x, &bg_scale_y);
+      scale = MAX (scale, MAX (bg_scale_x, bg_scale_y));
+    }
+
+  return scale * pp_pdf_dpi / 72.0;
+}
+
+/* file at --pdf-dpi, NULL when it is not larger than that. A jpeg stays one,
+ * at --pdf-jpeg-quality, the surface only carries the size like for a jpeg
+ * passed through. Anything else, a screenshot or a diagram, is not made
+ * lossy and goes in as pixels for cairo to deflate */
+static cairo_surface_t *
+_cairo_resample (CairoRenderer *renderer,
+                 const char    *key,
+                 const char    *file,
+                 gboolean       lossy,
+                 gint           width,
+                 gint           height)
+{
+  cairo_surface_t *surface;
+  GdkPixbuf       *pixbuf, *scaled;
+  PPPixels         pixels;
+  gchar           *jpeg = NULL;
+  gsize            length;
+  char            *quality;
+  float            scale;
+  gint             target_width, target_height;
+
+  scale = _cairo_image_scale (renderer, key, width, height);
+  if (scale <= 0.0 || scale >= 1.0)
+    return NULL;
+
+  target_width = MAX (1, width * scale + 0.5);
+  target_height = MAX (1, height * scale + 0.5);
+
+  /* the jpeg loader skips most of the work decoding at a fraction of the
+   * size, the filter does the rest from twice the size */
+  pixbuf = gdk_pixbuf_new_from_file_at_scale (file,
+                                              MIN (width, target_width * 2),
+                                              MIN (height, target_height * 2),
+                                              FALSE, NULL);
+  if (!pixbuf)
+    return NULL;
+  scaled = gdk_pixbuf_scale_simple (pixbuf, target_width, target_height,
+                                    GDK_INTERP_HYPER);
+  g_object_unref (pixbuf);
+  if (!scaled)
+    return NULL;
+
+  pp_pixels_from_pixbuf (&pixels, scaled);
+  quality = g_strdup_printf ("%d", CLAMP (pp_pdf_jpeg_quality, 1, 100));
+  if (lossy && pixels.opaque &&
+      gdk_pixbuf_save_to_buffer (scaled, &jpeg, &length, "jpeg", NULL,
+                                 "quality", quality, NULL))
+    {
+      pp_pixels_clear (&pixels);
+      surface = cairo_image_surface_create (CAIRO_FORMAT_RGB24,
+                                            target_width, target_height);
+      cairo_surface_set_mime_data (surface, CAIRO_MIME_TYPE_JPEG,
+                                   (unsigned char *) jpeg, length,
+                                   g_free, jpeg);
+    }
+  else
+    {
+      surface = _cairo_new_surface_from_pixels (&pixels);
     }
+  g_free (quality);
+  g_object_unref (scaled);
+
   return surface;
 }
 
+/* whether the pdf surface embeds jpeg as it is: a baseline, extended or
+ * progressive one with 1, 3 or 4 components of 8 bits, the size it is
+ * decoded to. cairo falls back to the pixels of any other, which are not
+ * there for a jpeg passed through */
 static gboolean
-_cairo_read_file (const char     *file,
-                  unsigned char **data,
-                  unsigned int   *len)
+_cairo_jpeg_usable (GMappedFile *jpeg,
+                    gint         width,
+                    gint         height)
 {
-    FILE *fp;
+  const guchar *p   = (const guchar *) g_mapped_file_get_contents (jpeg);
+  const guchar *end = p + g_mapped_file_get_length (jpeg);
+  guint         marker, length;
 
-    fp = fopen (file, "rb");
-    if (fp == NULL)
-      return FALSE;
+  if (end - p < 2 || p[0] != 0xff || p[1] != 0xd8)
+    return FALSE;
+  p += 2;
 
-    fseek (fp, 0, SEEK_END);
-    *len = ftell(fp);
-    fseek (fp, 0, SEEK_SET);
-    *data = g_malloc (*len);
+  while (p < end)
+    {
+      if (*p++ != 0xff)
+        continue;
+      while (p < end && *p == 0xff)
+        p++;
+      if (p >= end)
+        break;
+      marker = *p++;
+
+      /* markers without a segment */
+      if (marker == 0x00 || marker == 0x01 ||
+          (marker >= 0xd0 && marker <= 0xd8))
+        continue;
+      /* end of image or start of scan before a frame */
+      if (marker == 0xd9 || marker == 0xda)
+        break;
+      if (end - p < 2)
+        break;
+      length = (p[0] << 8) | p[1];
+      if (length < 2 || end - p < length)
+        break;
 
-    if (fread(*data, *len, 1, fp) != 1)
-	return FALSE;
+      switch (marker)
+        {
+        case 0xc0: /* baseline */
+        case 0xc1: /* extended sequential */
+        case 0xc2: /* progressive */
+          return length >= 8 &&
+                 p[2] == 8 &&
+                 ((p[3] << 8) | p[4]) == height &&
+                 ((p[5] << 8) | p[6]) == width &&
+                 (p[7] == 1 || p[7] == 3 || p[7] == 4);
+        case 0xc3: case 0xc5: case 0xc6: case 0xc7: /* lossless, */
+        case 0xc9: case 0xca: case 0xcb:            /* arithmetic, */
+        case 0xcd: case 0xce: case 0xcf:            /* hierarchical */
+          return FALSE;
+        }
+      p += length;
+    }
 
-    fclose(fp);
-    return TRUE;
+  return FALSE;
 }
 
 static cairo_surface_t *
@@ -215,39 +471,101 @@ _cairo_get_surface (CairoRenderer *renderer,
 {
   cairo_surface_t *surface;
   GdkPixbuf       *pixbuf;
+  GdkPixbufFormat *format;
+  GMappedFile     *jpeg = NULL;
+  gboolean         lossy = FALSE;
   GError          *error = NULL;
-
-  surface = g_hash_table_lookup (renderer->surfaces, file);
+  PPPixels         pixels;
+  char            *cache = NULL;
+  char            *name;
+  const char      *key;
+  gint             width, height;
+
+  key = _cairo_asset_key (renderer, file);
+  surface = _cairo_cache_claim (renderer, renderer->surfaces, key);
   if (surface)
     return surface;
 
-  pixbuf = gdk_pixbuf_new_from_file (file, &error);
-  if (pixbuf == NULL)
+  format = gdk_pixbuf_get_file_info (file, &width, &height);
+  if (format)
     {
-      if (error)
+      /* If we embed a JPEG, we can actually insert the coded data into the
+       * PDF in a lossless fashion (no recompression of the JPEG) */
+      name = gdk_pixbuf_format_get_name (format);
+      lossy = !g_strcmp0 (name, "jpeg");
+      if (lossy)
+        jpeg = g_mapped_file_new (file, FALSE, NULL);
+      g_free (name);
+
+      /* any other is decoded like a png */
+      if (jpeg && !_cairo_jpeg_usable (jpeg, width, height))
         {
-          g_warning ("could not load file %s: %s", file, error->message);
-          g_clear_error (&error);
+          g_mapped_file_unref (jpeg);
+          jpeg = NULL;
         }
-      return NULL;
     }
 
-  surface = _cairo_new_surface_from_pixbuf (pixbuf);
-  g_hash_table_insert (renderer->surfaces, g_strdup (file), surface);
+  /* resampled on the thread drawing the page, see cairo_renderer_run () */
+  if (renderer->surface && pp_pdf_dpi > 0 && format &&
+      (surface = _cairo_resample (renderer, key, file, lossy,
+                                  width, height)))
+    {
+      if (jpeg)
+        g_mapped_file_unref (jpeg);
+      jpeg = NULL;
+      goto out;
+    }
 
-  /* If we embed a JPEG, we can actually insert the coded data into the PDF in
-   * a lossless fashion (no recompression of the JPEG) */
-  if (g_str_has_suffix (file, ".jpg") || g_str_has_suffix (file, ".jpeg"))
-      {
-        unsigned char *data = NULL;
-        guint len = 0;
+  /* and then it is not decoded at all, the pdf surface takes the jpeg as it
+   * is and never looks at the pixels of an opaque image, these stay zero
+   * pages that are not even allocated */
+  if (jpeg && renderer->surface)
+    {
+      surface = cairo_image_surface_create (CAIRO_FORMAT_RGB24,
+                                            width, height);
+      goto out;
+    }
 
-        _cairo_read_file (file, &data, &len);
-        cairo_surface_set_mime_data (surface, CAIRO_MIME_TYPE_JPEG,
-                                     data, len,
-                                     g_free, data);
-      }
+  /* decoded at full size, for no bg_scale mode in particular */
+  if (format)
+    cache = pp_cache_path (file, 0, width, height);
+
+  if (!cache || !pp_cache_load (cache, &pixels))
+    {
+      pixbuf = gdk_pixbuf_new_from_file (file, &error);
+      if (pixbuf == NULL)
+        {
+          if (error)
+            {
+              g_warning ("could not load file %s: %s", file, error->message);
+              g_clear_error (&error);
+            }
+          g_free (cache);
+          if (jpeg)
+            g_mapped_file_unref (jpeg);
+          _cairo_cache_fill (renderer, renderer->surfaces, key, NULL);
+          return NULL;
+        }
+
+      pp_pixels_from_pixbuf (&pixels, pixbuf);
+      g_object_unref (pixbuf);
+      if (cache)
+        pp_cache_save (cache, &pixels);
+    }
+  g_free (cache);
+
+  surface = _cairo_new_surface_from_pixels (&pixels);
 
+out:
+  if (jpeg)
+    cairo_surface_set_mime_data (surface, CAIRO_MIME_TYPE_JPEG,
+                                 (unsigned char *)
+                                   g_mapped_file_get_contents (jpeg),
+                                 g_mapped_file_get_length (jpeg),
+                                 (cairo_destroy_func_t) g_mapped_file_unref,
+                                 jpeg);
+
+  _cairo_cache_fill (renderer, renderer->surfaces, key, surface);
   return surface;
 }
 
@@ -259,8 +577,9 @@ _cairo_get_svg (CairoRenderer *renderer,
 {
   RsvgHandle *svg;
   GError     *error = NULL;
+  const char *key = _cairo_asset_key (renderer, file);
 
-  svg = g_hash_table_lookup (renderer->svgs, file);
+  svg = _cairo_cache_claim (renderer, renderer->svgs, key);
   if (svg)
     return svg;
 
@@ -273,11 +592,9 @@ _cairo_get_svg (CairoRenderer *renderer,
           g_warning ("could not load file %s: %s", file, error->message);
           g_clear_error (&error);
         }
-      return NULL;
     }
 
-  g_hash_table_insert (renderer->svgs, (char *) file, svg);
-
+  _cairo_cache_fill (renderer, renderer->svgs, key, svg);
   return svg;
 }
 
@@ -285,36 +602,26 @@ _cairo_get_svg (CairoRenderer *renderer,
 
 static void
 _cairo_render_background (CairoRenderer *renderer,
+                          cairo_t       *cr,
                           PinPointPoint *point)
 {
-  char       *full_path = NULL;
   const char *file;
 
   if (point == NULL)
     return;
 
-  file = point->bg;
-
-  if (point->bg_type != PP_BG_COLOR && renderer->path && file)
-    {
-      char *dir = g_path_get_dirname (renderer->path);
-      full_path = g_build_filename (dir, file, NULL);
-      g_free (dir);
-
-      file = full_path;
-    }
+  file = point->bg_file;
 
-  if (point->stage_color)
+  if (point->stage_rgba)
     {
-      ClutterColor color;
-
-      clutter_color_from_string (&color, point->stage_color);
-      cairo_set_source_rgba (renderer->ctx,
-                             color.red / 255.f,
-                             color.green / 255.f,
-                             color.blue / 255.f,
-                             color.alpha / 255.f);
-      cairo_paint (renderer->ctx);
+      const ClutterColor *color = point->stage_rgba;
+
+      cairo_set_source_rgba (cr,
+                             color->red / 255.f,
+                             color->green / 255.f,
+                             color->blue / 255.f,
+                             color->alpha / 255.f);
+      cairo_paint (cr);
     }
 
   switch (point->bg_type)
@@ -323,15 +630,14 @@ _cairo_render_background (CairoRenderer *renderer,
       break;
     case PP_BG_COLOR:
       {
-        ClutterColor color;
-
-        clutter_color_from_string (&color, point->bg);
-        cairo_set_source_rgba (renderer->ctx,
-                               color.red / 255.f,
-                               color.green / 255.f,
-                               color.blue / 255.f,
-                               color.alpha / 255.f);
-        cairo_paint (renderer->ctx);
+        const ClutterColor *color = point->bg_rgba;
+
+        cairo_set_source_rgba (cr,
+                               color->red / 255.f,
+                               color->green / 255.f,
+                               color->blue / 255.f,
+                               color->alpha / 255.f);
+        cairo_paint (cr);
       }
       break;
     case PP_BG_IMAGE:
@@ -353,12 +659,12 @@ _cairo_render_background (CairoRenderer *renderer,
                                           &bg_x, &bg_y,
                                           &bg_scale_x, &bg_scale_y);
 
-        cairo_save (renderer->ctx);
-        cairo_translate (renderer->ctx, bg_x, bg_y);
-        cairo_scale (renderer->ctx, bg_scale_x, bg_scale_y);
-        cairo_set_source_surface (renderer->ctx, surface, 0., 0.);
-        cairo_paint (renderer->ctx);
-        cairo_restore (renderer->ctx);
+        cairo_save (cr);
+        cairo_translate (cr, bg_x, bg_y);
+        cairo_scale (cr, bg_scale_x, bg_scale_y);
+        cairo_set_source_surface (cr, surface, 0., 0.);
+        cairo_paint (cr);
+        cairo_restore (cr);
       }
       break;
     case PP_BG_VIDEO:
@@ -367,25 +673,34 @@ _cairo_render_background (CairoRenderer *renderer,
         GdkPixbuf       *pixbuf;
         cairo_surface_t *surface;
         float bg_x, bg_y, bg_width, bg_height, bg_scale_x, bg_scale_y;
-        GCancellable* cancellable = g_cancellable_new ();
+        GCancellable* cancellable;
         GFile *abs_file;
         gchar *abs_path;
 
-        abs_file = g_file_resolve_relative_path (pp_basedir, point->bg);
-        abs_path = g_file_get_path (abs_file);
-        g_object_unref (abs_file);
-
-        pixbuf = gst_video_thumbnailer_get_shot (abs_path, cancellable);
-        g_free (abs_path);
-        if (pixbuf == NULL)
+        surface = _cairo_cache_claim (renderer, renderer->surfaces, file);
+        if (surface == NULL)
           {
-            g_warning ("Could not create video thumbmail for %s", point->bg);
-            break;
+            abs_file = g_file_resolve_relative_path (pp_basedir, point->bg);
+            abs_path = g_file_get_path (abs_file);
+            g_object_unref (abs_file);
+
+            cancellable = g_cancellable_new ();
+            pixbuf = gst_video_thumbnailer_get_shot (abs_path, cancellable);
+            g_object_unref (cancellable);
+            g_free (abs_path);
+            if (pixbuf == NULL)
+              {
+                g_warning ("Could not create video thumbmail for %s",
+                           point->bg);
+                _cairo_cache_fill (renderer, renderer->surfaces, file, NULL);
+                break;
+              }
+
+            surface = _cairo_new_surface_from_pixbuf (pixbuf);
+            g_object_unref (pixbuf);
+            _cairo_cache_fill (renderer, renderer->surfaces, file, surface);
           }
 
-        surface = _cairo_new_surface_from_pixbuf (pixbuf);
-        g_hash_table_insert (renderer->surfaces, g_strdup (file), surface);
-
         bg_width = cairo_image_surface_get_width (surface);
         bg_height = cairo_image_surface_get_height (surface);
 
@@ -395,12 +710,12 @@ _cairo_render_background (CairoRenderer *renderer,
                                           &bg_x, &bg_y,
                                           &bg_scale_x, &bg_scale_y);
 
-        cairo_save (renderer->ctx);
-        cairo_translate (renderer->ctx, bg_x, bg_y);
-        cairo_scale (renderer->ctx, bg_scale_x, bg_scale_y);
-        cairo_set_source_surface (renderer->ctx, surface, 0., 0.);
-        cairo_paint (renderer->ctx);
-        cairo_restore (renderer->ctx);
+        cairo_save (cr);
+        cairo_translate (cr, bg_x, bg_y);
+        cairo_scale (cr, bg_scale_x, bg_scale_y);
+        cairo_set_source_surface (cr, surface, 0., 0.);
+        cairo_paint (cr);
+        cairo_restore (cr);
 #endif
         break;
       }
@@ -414,6 +729,7 @@ _cairo_render_background (CairoRenderer *renderer,
         if (svg == NULL)
           break;
 
+        g_mutex_lock (&renderer->svg_lock);
         rsvg_handle_get_dimensions (svg, &dim);
 
         pp_get_background_position_scale (point,
@@ -422,12 +738,13 @@ _cairo_render_background (CairoRenderer *renderer,
                                           &bg_x, &bg_y,
                                           &bg_scale_x, &bg_scale_y);
 
-        cairo_save (renderer->ctx);
-        cairo_translate (renderer->ctx, bg_x, bg_y);
-        cairo_scale (renderer->ctx, bg_scale_x, bg_scale_y);
-        rsvg_handle_render_cairo (svg, renderer->ctx);
+        cairo_save (cr);
+        cairo_translate (cr, bg_x, bg_y);
+        cairo_scale (cr, bg_scale_x, bg_scale_y);
+        rsvg_handle_render_cairo (svg, cr);
+        g_mutex_unlock (&renderer->svg_lock);
 
-        cairo_restore (renderer->ctx);
+        cairo_restore (cr);
       }
 #endif
       break;
@@ -437,28 +754,25 @@ _cairo_render_background (CairoRenderer *renderer,
     default:
       g_assert_not_reached();
     }
-
-  g_free (full_path);
 }
 
 static void
 _cairo_render_text (CairoRenderer *renderer,
+                    cairo_t       *cr,
                     PinPointPoint *point)
 {
   PangoLayout          *layout;
-  PangoFontDescription *desc;
   PangoRectangle        logical_rect = { 0, };
-  ClutterColor          text_color,
-                        shading_color;
+  const ClutterColor   *text_color,
+                       *shading_color;
 
   float text_x,    text_y,    text_width,    text_height,   text_scale;
   float shading_x, shading_y, shading_width, shading_height;
   if (point == NULL)
     return;
 
-  layout = pango_cairo_create_layout (renderer->ctx);
-  desc = pango_font_description_from_string (point->font);
-  pango_layout_set_font_description (layout, desc);
+  layout = pango_cairo_create_layout (cr);
+  pango_layout_set_font_description (layout, point->font_desc);
   if (point->use_markup)
     pango_layout_set_markup (layout, point->text, -1);
   else
@@ -484,76 +798,146 @@ _cairo_render_text (CairoRenderer *renderer,
                                 &shading_x, &shading_y,
                                 &shading_width, &shading_height);
 
-  clutter_color_from_string (&text_color, point->text_color);
-  clutter_color_from_string (&shading_color, point->shading_color);
+  text_color = point->text_rgba;
+  shading_color = point->shading_rgba;
 
-  cairo_set_source_rgba (renderer->ctx,
-                         shading_color.red / 255.f,
-                         shading_color.green / 255.f,
-                         shading_color.blue / 255.f,
-                         shading_color.alpha / 255.f * point->shading_opacity);
-  cairo_rectangle (renderer->ctx,
+  cairo_set_source_rgba (cr,
+                         shading_color->red / 255.f,
+                         shading_color->green / 255.f,
+                         shading_color->blue / 255.f,
+                         shading_color->alpha / 255.f * point->shading_opacity);
+  cairo_rectangle (cr,
                    shading_x, shading_y, shading_width, shading_height);
-  cairo_fill (renderer->ctx);
-
-  cairo_save (renderer->ctx);
-  cairo_translate (renderer->ctx, text_x, text_y);
-  cairo_scale (renderer->ctx, text_scale, text_scale);
-  cairo_set_source_rgba (renderer->ctx,
-                         text_color.red / 255.f,
-                         text_color.green / 255.f,
-                         text_color.blue / 255.f,
-                         text_color.alpha / 255.f);
-  pango_cairo_show_layout (renderer->ctx, layout);
-  cairo_restore (renderer->ctx);
+  cairo_fill (cr);
+
+  cairo_save (cr);
+  cairo_translate (cr, text_x, text_y);
+  cairo_scale (cr, text_scale, text_scale);
+  cairo_set_source_rgba (cr,
+                         text_color->red / 255.f,
+                         text_color->green / 255.f,
+                         text_color->blue / 255.f,
+                         text_color->alpha / 255.f);
+  pango_cairo_show_layout (cr, layout);
+  cairo_restore (cr);
 
 out:
-  pango_font_description_free (desc);
   g_object_unref (layout);
 }
 
-void
-cairo_renderer_render_page (CairoRenderer *renderer,
-                            PinPointPoint *point)
-{
-  _cairo_render_background (renderer, point);
-  _cairo_render_text (renderer, point);
-  cairo_show_page (renderer->ctx);
-}
-
 static void
 _cairo_render_notes (CairoRenderer *renderer,
+                     cairo_t       *cr,
                      PinPointPoint *point)
 {
   PangoLayout          *layout;
-  PangoFontDescription *desc;
 
   if (point == NULL)
     return;
 
-  layout = pango_cairo_create_layout (renderer->ctx);
+  layout = pango_cairo_create_layout (cr);
   pango_layout_set_text (layout, point->speaker_notes, -1);
 
-  desc = pango_font_description_from_string ("Sans");
-  pango_layout_set_font_description (layout, desc);
+  pango_layout_set_font_description (layout, pp_style_font ("Sans"));
 
   pango_layout_set_alignment (layout, PANGO_ALIGN_LEFT);
 
-  cairo_save (renderer->ctx);
-  cairo_translate (renderer->ctx, A4_MARGIN, A4_MARGIN);
-  cairo_set_source_rgba (renderer->ctx, 0., 0., 0., 1);
-  pango_cairo_show_layout (renderer->ctx, layout);
-  cairo_restore (renderer->ctx);
+  cairo_save (cr);
+  cairo_translate (cr, A4_MARGIN, A4_MARGIN);
+  cairo_set_source_rgba (cr, 0., 0., 0., 1);
+  pango_cairo_show_layout (cr, layout);
+  cairo_restore (cr);
 
-  pango_font_description_free (desc);
   g_object_unref (layout);
 }
 
+/*
+ * Exporting
+ *
+ * Each slide, and its page of speaker notes, is drawn into recording
+ * surfaces by a pool of threads, where the backgrounds are decoded and the
+ * text laid out. The main thread replays them into the pdf in order, as they
+ * come in, with at most PP_PAGES_AHEAD pages per thread recorded but not yet
+ * written. The images and svgs in the caches are shared between the pages,
+ * so each one is still only included once.
+ *
+ * cairo writes a replayed page as a form XObject, so with a single thread,
+ * on one core or with -j1, the pages are drawn straight into the pdf instead,
+ * which gives the pdf drawing them one after the other always gave.
+ */
+
+#define PP_PAGES_AHEAD 4
+
+typedef struct
+{
+  CairoRenderer   *renderer;
+  PinPointPoint   *point;
+  cairo_surface_t *page;    /* set once recorded */
+  cairo_surface_t *notes;
+  gboolean         done;
+} CairoPage;
+
+static GMutex cairo_pages_lock;
+static GCond  cairo_pages_cond;
+
+static cairo_surface_t *
+_cairo_record (CairoRenderer *renderer,
+               PinPointPoint *point,
+               gboolean       notes)
+{
+  cairo_rectangle_t extents = { 0, 0, renderer->width, renderer->height };
+  cairo_surface_t  *surface;
+  cairo_t          *cr;
+
+  surface = cairo_recording_surface_create (CAIRO_CONTENT_COLOR_ALPHA,
+                                            &extents);
+  cr = cairo_create (surface);
+  if (notes)
+    {
+      _cairo_render_notes (renderer, cr, point);
+    }
+  else
+    {
+      _cairo_render_background (renderer, cr, point);
+      _cairo_render_text (renderer, cr, point);
+    }
+  cairo_destroy (cr);
+
+  return surface;
+}
+
+static void
+_cairo_record_page (gpointer data,
+                    gpointer user_data)
+{
+  CairoPage *page = data;
+
+  page->page = _cairo_record (page->renderer, page->point, FALSE);
+  if (page->point->speaker_notes)
+    page->notes = _cairo_record (page->renderer, page->point, TRUE);
+
+  g_mutex_lock (&cairo_pages_lock);
+  page->done = TRUE;
+  g_cond_broadcast (&cairo_pages_cond);
+  g_mutex_unlock (&cairo_pages_lock);
+}
+
 static void
-cairo_render_speaker_notes (CairoRenderer *renderer,
+_cairo_replay (CairoRenderer   *renderer,
+               cairo_surface_t *recording)
+{
+  cairo_set_source_surface (renderer->ctx, recording, 0., 0.);
+  cairo_paint (renderer->ctx);
+  cairo_show_page (renderer->ctx);
+  cairo_surface_destroy (recording);
+}
+
+void
+cairo_renderer_render_page (CairoRenderer *renderer,
                             PinPointPoint *point)
 {
-  _cairo_render_notes (renderer, point);
+  _cairo_render_background (renderer, renderer->ctx, point);
+  _cairo_render_text (renderer, renderer->ctx, point);
   cairo_show_page (renderer->ctx);
 }
 
@@ -561,30 +945,140 @@ static void
 cairo_renderer_run (PinPointRenderer *pp_renderer)
 {
   CairoRenderer *renderer = CAIRO_RENDERER (pp_renderer);
-  GList         *cur;
+  GThreadPool   *pool;
+  CairoPage     *pages;
+  guint          n_pages, n_threads, queued = 0, i;
+
+  pp_stream_finish (); /* every page is needed */
+  n_pages = pp_slides->len;
+  if (!n_pages)
+    return;
+
+  n_threads = pp_pdf_jobs > 0 ? pp_pdf_jobs : g_get_num_processors ();
+  if (n_threads == 1)
+    {
+      for (i = 0; i < n_pages; i++)
+        {
+          PinPointPoint *point = pp_slide_nth (i);
+
+          cairo_renderer_render_page (renderer, point);
+          if (point->speaker_notes)
+            {
+              _cairo_render_notes (renderer, renderer->ctx, point);
+              cairo_show_page (renderer->ctx);
+            }
+        }
+      return;
+    }
 
-  for (cur = pp_slides; cur; cur = g_list_next (cur))
+  pool = g_thread_pool_new (_cairo_record_page, NULL, n_threads, TRUE, NULL);
+  pages = g_new0 (CairoPage, n_pages);
+
+  for (i = 0; i < n_pages; i++)
     {
-      PinPointPoint *point = cur->data;
+      CairoPage *page = &pages[i];
+
+      for (; queued < n_pages && queued < i + n_threads * PP_PAGES_AHEAD;
+           queued++)
+        {
+          pages[queued].renderer = renderer;
+          pages[queued].point = pp_slide_nth (queued);
+          g_thread_pool_push (pool, &pages[queued], NULL);
+        }
+
+      g_mutex_lock (&cairo_pages_lock);
+      while (!page->done)
+        g_cond_wait (&cairo_pages_cond, &cairo_pages_lock);
+      g_mutex_unlock (&cairo_pages_lock);
+
+      _cairo_replay (renderer, page->page);
+      if (page->notes)
+        _cairo_replay (renderer, page->notes);
+    }
+
+  g_thread_pool_free (pool, FALSE, TRUE);
+  g_free (pages);
+}
+
+/* what each image costs in the pdf: a jpeg goes in as it is, so its size is
+ * what is embedded, the others are deflated by cairo, which does not say to
+ * what, so theirs is the raw size of the pixels, an alpha channel as a mask
+ * of its own */
+static void
+_cairo_report_images (CairoRenderer *renderer)
+{
+  GHashTableIter   iter;
+  const char      *file;
+  cairo_surface_t *surface;
+  guint64          embedded = 0, raw = 0;
+  guint            n_jpegs = 0, n_raw = 0;
 
-      cairo_renderer_render_page (renderer, point);
-      if (point->speaker_notes)
-        cairo_render_speaker_notes (renderer, point);
+  g_hash_table_iter_init (&iter, renderer->surfaces);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &file,
+                                 (gpointer *) &surface))
+    {
+      const unsigned char *jpeg;
+      unsigned long        length;
+      gint                 width, height;
+      guint64              bytes;
+      const char          *kind;
+
+      if (!surface)
+        continue;
+
+      width = cairo_image_surface_get_width (surface);
+      height = cairo_image_surface_get_height (surface);
+      cairo_surface_get_mime_data (surface, CAIRO_MIME_TYPE_JPEG,
+                                   &jpeg, &length);
+      if (jpeg)
+        {
+          kind = "of jpeg embedded";
+          bytes = length;
+          embedded += bytes;
+          n_jpegs++;
+        }
+      else
+        {
+          kind = "raw, deflated by cairo";
+          bytes = (guint64) width * height *
+            (cairo_image_surface_get_format (surface) ==
+             CAIRO_FORMAT_RGB24 ? 3 : 4);
+          raw += bytes;
+          n_raw++;
+        }
+      g_debug ("pdf: %s %dx%d, %" G_GUINT64_FORMAT " bytes %s",
+               file, width, height, bytes, kind);
     }
+  g_print ("pdf: %u jpeg images, %.1fMB embedded as they are, "
+           "%u other images, %.1fMB raw before cairo deflates them\n",
+           n_jpegs, embedded / (1024.0 * 1024.0),
+           n_raw, raw / (1024.0 * 1024.0));
 }
 
 static void
 cairo_renderer_finalize (PinPointRenderer *pp_renderer)
 {
   CairoRenderer *renderer = CAIRO_RENDERER (pp_renderer);
+  gboolean       pdf = renderer->surface != NULL;
+  GStatBuf       st;
+
+  if (pdf)
+    _cairo_report_images (renderer);
 
   g_free (renderer->path);
   if (renderer->surface)
     cairo_surface_destroy (renderer->surface);
   g_hash_table_unref (renderer->surfaces);
   g_hash_table_unref (renderer->svgs);
+  g_hash_table_unref (renderer->assets);
+  g_hash_table_unref (renderer->sizes);
   if (renderer->ctx)
     cairo_destroy (renderer->ctx);
+
+  /* written out by now */
+  if (pdf && g_stat (pp_output_filename, &st) == 0)
+    g_print ("pdf: %s, %.1fMB written\n",
+             pp_output_filename, st.st_size / (1024.0 * 1024.0));
 }
 
 
@@ -595,11 +1089,7 @@ cairo_renderer_make_point (PinPointRenderer *pp_renderer,
   gboolean ret = TRUE;
 
   if (point->bg_type == PP_BG_COLOR)
-    {
-      ClutterColor color;
-
-      ret = clutter_color_from_string (&color, point->bg); /* this roughly checks that the color is valid? */
-    }
+    ret = point->bg_rgba != NULL;
 
   return ret;
 }
@@ -31,12 +31,16 @@
 #include <clutter/x11/clutter-x11.h>
 #endif
 #include <gio/gio.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
 #ifdef USE_CLUTTER_GST
 #include <clutter-gst/clutter-gst.h>
 #endif
 #ifdef USE_DAX
 #include <dax/dax.h>
 #include "pp-super-aa.h"
+#elif defined (HAVE_RSVG)
+#include <librsvg/rsvg.h>
+#include <librsvg/rsvg-cairo.h>
 #endif
 #include <stdlib.h>
 #include <string.h>
@@ -97,6 +101,7 @@ typedef struct _ClutterRenderer
 {
   PinPointRenderer renderer;
   GHashTable      *bg_cache;    /* only load the same backgrounds once */
+  GHashTable      *bg_watches;  /* bg_file -> PPAssetWatch, see watch_asset () */
   ClutterActor    *stage;
   ClutterActor    *root;
 
@@ -121,6 +126,17 @@ typedef struct _ClutterRenderer
 
   gdouble          slide_start_time;
 
+  guint            bench_pass;      /* --benchmark-frames, see bench_step () */
+  guint            bench_frames;
+  gint64           bench_stepped;   /* when the last slide was shown */
+  gint64           bench_start;     /* of the frame being drawn */
+  gint64           bench_total;
+  gint64           bench_worst;
+
+  GArray          *time_planned;   /* prefix sums of the slide durations, */
+  GArray          *time_rehearsed; /* see timing_update () */
+  gboolean         timing_dirty;
+
   ClutterActor    *speaker_buttons_group;
   ClutterActor    *speaker_buttonbar;
   ClutterActor    *speaker_speakerscreen;
@@ -147,6 +163,8 @@ typedef struct _ClutterRenderer
 
   char *path;               /* path of the file of the GFileMonitor callback */
   float rest_y;             /* where the text can rest */
+  struct _ClutterPointData *shown; /* of the slide show_slide () showed last,
+                                      NULL once that is freed */
 
   gboolean reset;           /* tells the speaker screen update function to
                                reset all state
@@ -154,6 +172,20 @@ typedef struct _ClutterRenderer
 
   PinPointRenderer *cairo_renderer;
 
+  guint             reload_count;      /* hot reload statistics, reported */
+  gint64            reload_time_total; /* by reload_done () in microseconds */
+  gint64            reload_start;
+
+  guint             texture_stamp;     /* texture_window () calls so far */
+  gsize             texture_bytes;     /* of the loaded backgrounds */
+  gsize             texture_peak;
+  gsize             texture_saved;     /* by keeping opaque ones as RGB565 */
+  gsize             texture_saved_peak;
+  guint             texture_hits;      /* --texture-budget statistics, */
+  guint             texture_misses;    /* reported on exit */
+  guint             texture_prefetches;
+  guint             texture_evictions;
+
   /* Proxy object for the Gnome Session Manager; used to inhibit suspend during
    * presentations.
    */
@@ -166,12 +198,16 @@ typedef struct _ClutterRenderer
   PPClutterBackend  clutter_backend;
 } ClutterRenderer;
 
-typedef struct
+typedef struct _ClutterPointData
 {
   PinPointRenderer *renderer;
   ClutterActor     *background;
-  ClutterActor     *text;
+  struct _PPTexture *texture; /* for an image, background is a clone of it */
+  ClutterActor     *text;       /* NULL while the slide is not made, see
+                                   slide_window () */
   float rest_y;     /* y coordinate when text is stationary unused */
+  gboolean          leaving;  /* animating away, hidden after that */
+  guint             park_tag; /* of the slide_park () doing that */
 
   ClutterState     *state;
   ClutterActor     *json_slide;
@@ -183,11 +219,74 @@ typedef struct
 
 #ifdef USE_CLUTTER_GST
   ClutterGstPlayer *player;
+  gulong            size_change; /* handler on player */
 #endif
 } ClutterPointData;
 
 #define CLUTTER_RENDERER(renderer)  ((ClutterRenderer *) renderer)
 
+typedef struct
+{
+  ClutterRenderer *renderer;
+  char            *file;
+  GFileMonitor    *monitor;
+  guint            tag;      /* of a pending asset_reload () */
+} PPAssetWatch;
+
+typedef struct _PPTexture
+{
+  ClutterRenderer *renderer;
+  guint            refs;     /* slides using it */
+  char            *file;     /* the key in bg_cache */
+  ClutterActor    *texture;  /* hidden child of the stage holding the tiles,
+                                slides show clones of it */
+  gboolean         resident; /* loaded or being loaded */
+  gsize            bytes;    /* once loaded */
+  gsize            saved;    /* bytes less than as RGBA */
+  CoglPixelFormat  format;   /* of the tiles */
+  gint             bpp;      /* what the GPU keeps a pixel of it in */
+  PPPixels         pixels;   /* of a tiled one, until the tiles in view are up */
+  guint8          *tiles;    /* which of those are up, NULL when not tiled */
+  gint             columns;
+  gint             rows;
+  gint             tiled_width;  /* of the decode split into them */
+  gint             tiled_height;
+  gsize            uploaded; /* pixels */
+  guint            modes;    /* 1 << bg_scale of the slides using it */
+  gint             width;    /* of the file, once decoded */
+  gint             height;
+  float            scale;    /* it was decoded at */
+  struct _PPDecode *decode;  /* in flight, see texture_load () */
+  gboolean         svg;      /* rasterized, any scale will do */
+  guint            shown;    /* texture_stamp when last shown */
+  guint            wanted;   /* texture_stamp when last in the window */
+} PPTexture;
+
+/*
+ * Images are decoded by texture_decode () on a pool of threads, straight to
+ * the size the stage needs with gdk_pixbuf_new_from_file_at_scale (), which
+ * lets the jpeg loader skip most of the work for a large photo. Without Dax
+ * svgs are rasterized there too, by librsvg. Either is looked up in the
+ * cache of decoded backgrounds first, see pp_cache_path (). texture_upload ()
+ * turns the results into textures on the main loop, a few milliseconds
+ * worth per frame.
+ */
+typedef struct _PPDecode
+{
+  PPTexture       *entry;   /* NULL once the result is not wanted */
+  char            *file;
+  gboolean         svg;
+  guint            modes;
+  float            stage_width;
+  float            stage_height;
+
+  PPPixels         pixels;  /* set by texture_decode () */
+  gint             width;   /* of the file */
+  gint             height;
+  float            scale;
+  GError          *error;
+} PPDecode;
+
 
 static void     leave_slide   (ClutterRenderer  *renderer,
                                gboolean          backwards);
@@ -200,6 +299,14 @@ static void     file_changed  (GFileMonitor     *monitor,
                                GFile            *other_file,
                                GFileMonitorEvent event_type,
                                ClutterRenderer  *renderer);
+static void     watch_asset   (ClutterRenderer  *renderer,
+                               const char       *file);
+static void     unwatch_asset (gpointer          data);
+static void     texture_evict (ClutterRenderer  *renderer);
+static void     texture_load  (PPTexture        *entry);
+static void     state_completed (ClutterState   *state,
+                                 gpointer        user_data);
+static void     bench_init    (ClutterRenderer  *renderer);
 static void     stage_resized (ClutterActor     *actor,
                                GParamSpec       *pspec,
                                ClutterRenderer  *renderer);
@@ -276,6 +383,14 @@ pp_clutter_render_adjust_background (ClutterRenderer *renderer,
   else
     {
       clutter_actor_get_size (data->background, &bg_width, &bg_height);
+
+      /* a texture that is still loading has no size yet, a compiled
+       * presentation knows what it will be */
+      if (bg_width < 1.0 && point->bg_width > 0)
+        {
+          bg_width = point->bg_width;
+          bg_height = point->bg_height;
+        }
     }
 
   pp_get_background_position_scale (point,
@@ -390,9 +505,18 @@ pp_get_fullscreen (ClutterRenderer *renderer,
 static void
 _destroy_surface (gpointer data)
 {
-  /* not destroying background, since it would be destroyed with
-   * the stage itself.
-   */
+  PPTexture *entry = data;
+
+  if (entry->decode)
+    entry->decode->entry = NULL;
+  entry->renderer->texture_bytes -= entry->bytes;
+  entry->renderer->texture_saved -= entry->saved;
+  if (entry->pixels.data)
+    pp_pixels_clear (&entry->pixels);
+  g_free (entry->tiles);
+  clutter_actor_destroy (entry->texture);
+  g_free (entry->file);
+  g_slice_free (PPTexture, entry);
 }
 
 static guint hide_cursor = 0;
@@ -410,11 +534,10 @@ activate_commandline (ClutterRenderer *renderer)
 {
   PinPointPoint *point;
 
-  if (!pp_slidep)
+  point = pp_slide_nth (pp_slide_no);
+  if (!point)
     return;
 
-  point = pp_slidep->data;
-
   pp_actor_animate (renderer->commandline, CLUTTER_LINEAR, 500,
                      "opacity", 0xff, NULL);
 
@@ -436,7 +559,7 @@ static gboolean commandline_cancel_cb (ClutterActor *actor,
                                        gpointer      data)
 {
   ClutterRenderer *renderer = CLUTTER_RENDERER (data);
-  PinPointPoint *point = pp_slidep->data;
+  PinPointPoint *point = pp_slide_nth (pp_slide_no);
 
   if (clutter_event_type (event) == CLUTTER_KEY_PRESS &&
       (clutter_event_get_key_symbol (event) == CLUTTER_Escape ||
@@ -460,7 +583,7 @@ static gboolean commandline_action_cb (ClutterActor *actor,
                                        gpointer      data)
 {
   ClutterRenderer *renderer = CLUTTER_RENDERER (data);
-  PinPointPoint *point = pp_slidep->data;
+  PinPointPoint *point = pp_slide_nth (pp_slide_no);
   clutter_actor_grab_key_focus (renderer->stage);
   pp_actor_animate (renderer->commandline,
                     CLUTTER_LINEAR, 500,
@@ -527,12 +650,7 @@ static gboolean stage_motion (ClutterActor *actor,
     {
       float d = event->motion.x / stage_width;
 #endif
-      if (pp_slidep)
-        {
-          leave_slide (renderer, FALSE);
-        }
-      pp_slidep = g_list_nth (pp_slides, g_list_length (pp_slides) * d);
-      show_slide (renderer, FALSE);
+      goto_slide (renderer, pp_slides->len * d);
     }
 #endif
 
@@ -620,14 +738,31 @@ toggle_autoadvance (ClutterActor *actor,
 
 static void end_of_presentation (ClutterRenderer *renderer);
 
+static void
+goto_slide (ClutterRenderer *renderer,
+            gint             slide_no)
+{
+  gboolean backwards = slide_no < pp_slide_no;
+
+  if (!pp_slide_nth (slide_no) || slide_no == pp_slide_no)
+    return;
+
+  if (pp_slide_nth (pp_slide_no))
+    leave_slide (renderer, backwards);
+  pp_slide_no = slide_no;
+  show_slide (renderer, backwards);
+}
+
 static void
 next_slide (ClutterRenderer *renderer)
 {
-  if (pp_slidep && pp_slidep->next)
+  /* caught up with a presentation that is still loading */
+  if (!pp_slide_nth (pp_slide_no + 1))
+    pp_stream_finish ();
+
+  if (pp_slide_nth (pp_slide_no) && pp_slide_nth (pp_slide_no + 1))
     {
-      leave_slide (renderer, FALSE);
-      pp_slidep = pp_slidep->next;
-      show_slide (renderer, FALSE);
+      goto_slide (renderer, pp_slide_no + 1);
     }
   else
     {
@@ -638,11 +773,9 @@ next_slide (ClutterRenderer *renderer)
 static void
 prev_slide (ClutterRenderer *renderer)
 {
-  if (pp_slidep && pp_slidep->prev)
+  if (pp_slide_nth (pp_slide_no) && pp_slide_nth (pp_slide_no - 1))
     {
-      leave_slide (renderer, TRUE);
-      pp_slidep = pp_slidep->prev;
-      show_slide (renderer, TRUE);
+      goto_slide (renderer, pp_slide_no - 1);
     }
 }
 
@@ -679,7 +812,7 @@ start (ClutterActor *actor,
   g_timer_start (renderer->timer);
   renderer->timer_paused = FALSE;
   leave_slide (renderer, TRUE);
-  pp_slidep = pp_slides;
+  pp_slide_no = 0;
   play_pause (NULL, NULL, data);
   play_pause (NULL, NULL, data);
   if (pp_rehearse)
@@ -687,6 +820,7 @@ start (ClutterActor *actor,
       pp_rehearse = FALSE;
     }
   pp_rehearse_init (); /* zeroes out the new-time */
+  renderer->timing_dirty = TRUE;
   show_slide (renderer, TRUE);
   renderer->reset = TRUE;
   return TRUE;
@@ -700,6 +834,7 @@ start_rehearse (ClutterActor *actor,
   start (actor, event, data);
   pp_rehearse = TRUE;
   pp_rehearse_init ();
+  CLUTTER_RENDERER (data)->timing_dirty = TRUE;
 
   return FALSE;
 }
@@ -941,6 +1076,9 @@ clutter_renderer_init (PinPointRenderer   *pp_renderer,
   GDBusConnection *session_bus;
   ClutterBackend *backend;
 
+  if (pp_benchmark_frames)
+    bench_init (renderer);
+
   renderer->stage = stage = clutter_stage_new ();
   clutter_stage_set_title(CLUTTER_STAGE(stage), "Pinpoint presentation");
   renderer->root = clutter_actor_new ();
@@ -983,6 +1121,10 @@ clutter_renderer_init (PinPointRenderer   *pp_renderer,
   renderer->timer_paused = FALSE;
   renderer->timer = g_timer_new ();
 
+  renderer->time_planned = g_array_new (FALSE, TRUE, sizeof (gdouble));
+  renderer->time_rehearsed = g_array_new (FALSE, TRUE, sizeof (gdouble));
+  renderer->timing_dirty = TRUE;
+
 
   if (pp_speakermode)
     toggle_speaker_screen (renderer);
@@ -1039,6 +1181,8 @@ clutter_renderer_init (PinPointRenderer   *pp_renderer,
 
   renderer->bg_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
                                               NULL, _destroy_surface);
+  renderer->bg_watches = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                NULL, unwatch_asset);
 
   renderer->cairo_renderer = pp_cairo_renderer ();
   renderer->cairo_renderer->init (renderer->cairo_renderer, pinpoint_file);
@@ -1081,37 +1225,659 @@ clutter_renderer_finalize (PinPointRenderer *pp_renderer)
 {
   ClutterRenderer *renderer = CLUTTER_RENDERER (pp_renderer);
 
-  clutter_actor_destroy (renderer->stage);
+  if (pp_texture_budget > 0)
+    g_print ("textures: %u hits, %u misses, %u prefetched, %u evicted, "
+             "peak %.1fMB of %dMB\n",
+             renderer->texture_hits, renderer->texture_misses,
+             renderer->texture_prefetches, renderer->texture_evictions,
+             renderer->texture_peak / (1024.0 * 1024.0), pp_texture_budget);
+  if (pp_rgb565)
+    g_print ("textures: opaque backgrounds kept as RGB565 saved up to %.1fMB\n",
+             renderer->texture_saved_peak / (1024.0 * 1024.0));
+
+  g_hash_table_unref (renderer->bg_watches);
   g_hash_table_unref (renderer->bg_cache);
+  clutter_actor_destroy (renderer->stage);
   g_clear_object (&renderer->gsm);
+  g_array_free (renderer->time_planned, TRUE);
+  g_array_free (renderer->time_rehearsed, TRUE);
 }
 
-static ClutterActor *
-_clutter_get_texture (ClutterRenderer *renderer,
-                      const char      *file)
+/*
+ * Background textures
+ *
+ * bg_cache has a PPTexture for every image file, the slides show clones of
+ * its texture. Without --texture-budget all of them are loaded when the
+ * slides are made and stay. With it only the current slide and the
+ * --texture-window slides ahead of it in the direction of travel (and one
+ * behind) are loaded by texture_window (), the least recently shown of the
+ * others are unloaded once the budget is exceeded. An entry no slide refers
+ * to any more, after a reload dropped it, goes right away.
+ *
+ * A decode larger than PP_TILE_SIZE, a panorama filling the stage say, is
+ * split into tiles and only those the made slides show on the stage are made
+ * into textures. The pixels go once those are up, tiles that go out of view
+ * when the slide or the stage changes are dropped, and one that comes into
+ * view is decoded again, from the cache of decoded backgrounds usually.
+ */
+
+#define PP_TILE_SIZE 2048 /* within the maximum texture size of any GPU */
+
+static void
+texture_loaded (PPTexture *entry,
+                gsize      n_pixels,
+                gint       bpp)
 {
-  ClutterActor *source;
+  ClutterRenderer  *renderer = entry->renderer;
+  PinPointPoint    *point = pp_slide_nth (pp_slide_no);
+  ClutterPointData *data;
+
+  renderer->texture_bytes -= entry->bytes;
+  renderer->texture_saved -= entry->saved;
+  entry->bytes = n_pixels * bpp;
+  entry->saved = n_pixels * (4 - bpp);
+  renderer->texture_bytes += entry->bytes;
+  renderer->texture_saved += entry->saved;
+  renderer->texture_peak = MAX (renderer->texture_peak,
+                                renderer->texture_bytes);
+  renderer->texture_saved_peak = MAX (renderer->texture_saved_peak,
+                                      renderer->texture_saved);
+
+  /* the size changes with every decode */
+  if (point && (data = point->data) && data->texture == entry &&
+      data->background)
+    pp_clutter_render_adjust_background (renderer, point);
+
+  if (pp_texture_budget > 0)
+    texture_evict (renderer);
+}
+
+/* the largest scale any of the slides in modes shows a width x height image
+ * at on the stage, never more than 1 unless it is a vector one, see
+ * pp_get_background_position_scale () */
+static float
+texture_scale (guint    modes,
+               gboolean vector,
+               float    width,
+               float    height,
+               float    stage_width,
+               float    stage_height)
+{
+  float w_scale, h_scale, scale = 0.0;
+
+  if (width < 1 || height < 1 || stage_width < 1 || stage_height < 1)
+    return 1.0;
+
+  w_scale = stage_width / width;
+  h_scale = stage_height / height;
+  if (modes & (1 << PP_BG_FIT | 1 << PP_BG_UNSCALED))
+    scale = MAX (scale, MIN (w_scale, h_scale));
+  if (modes & (1 << PP_BG_FILL | 1 << PP_BG_STRETCH))
+    scale = MAX (scale, MAX (w_scale, h_scale));
+
+  return vector ? scale : MIN (scale, 1.0);
+}
+
+#define PP_UPLOAD_BUDGET 4000 /* microseconds of uploading per frame */
+
+static GThreadPool *texture_decoder = NULL;
+static GQueue       texture_uploads = G_QUEUE_INIT; /* decoded PPDecodes */
+static guint        texture_upload_tag = 0;
+
+static CoglHandle
+texture_cogl (PPTexture *entry,
+              PPPixels  *pixels,
+              gint       x,
+              gint       y,
+              gint       width,
+              gint       height)
+{
+  return cogl_texture_new_from_data (width, height, COGL_TEXTURE_NONE,
+                                     CLUTTER_CAIRO_FORMAT_ARGB32,
+                                     entry->format,
+                                     pixels->stride,
+                                     pixels->data + y * pixels->stride + x * 4);
+}
 
-  source = g_hash_table_lookup (renderer->bg_cache, file);
-  if (source)
+static void
+texture_tile_set (ClutterActor *tile,
+                  CoglHandle    tex)
+{
+  clutter_texture_set_cogl_texture (CLUTTER_TEXTURE (tile), tex);
+  cogl_handle_unref (tex);
+}
+
+/* drops the tiles and the pixels still waiting for them */
+static void
+texture_clear (PPTexture *entry)
+{
+  clutter_actor_destroy_all_children (entry->texture);
+  if (entry->pixels.data)
+    pp_pixels_clear (&entry->pixels);
+  g_free (entry->tiles);
+  entry->tiles = NULL;
+  entry->uploaded = 0;
+}
+
+/* makes textures of the tiles the made slides show at the current stage
+ * size and drops the others, decoding again when one is missing */
+static void
+texture_tiles_update (PPTexture *entry)
+{
+  PPPixels      *pixels = &entry->pixels;
+  float          stage_width, stage_height;
+  float          x0, y0, x1, y1;
+  PinPointPoint *point;
+  gint           i, row, column;
+  gboolean       changed = FALSE, missing = FALSE;
+
+  if (!entry->tiles)
+    return;
+
+  clutter_actor_get_size (entry->renderer->stage, &stage_width, &stage_height);
+  x0 = entry->columns * PP_TILE_SIZE;
+  y0 = entry->rows * PP_TILE_SIZE;
+  x1 = y1 = 0;
+  for (i = 0; (point = pp_slide_nth (i)); i++)
     {
-      return clutter_clone_new (source);
+      ClutterPointData *data = point->data;
+      float bg_x, bg_y, bg_scale_x, bg_scale_y;
+
+      if (!data || !data->text || data->texture != entry)
+        continue;
+
+      pp_get_background_position_scale (point, stage_width, stage_height,
+                                        entry->tiled_width,
+                                        entry->tiled_height,
+                                        &bg_x, &bg_y,
+                                        &bg_scale_x, &bg_scale_y);
+      x0 = MIN (x0, -bg_x / bg_scale_x);
+      y0 = MIN (y0, -bg_y / bg_scale_y);
+      x1 = MAX (x1, (stage_width - bg_x) / bg_scale_x);
+      y1 = MAX (y1, (stage_height - bg_y) / bg_scale_y);
     }
 
-  source = g_object_new (CLUTTER_TYPE_TEXTURE,
-                         "filename", file,
-                         "load-data-async", TRUE,
-                         NULL);
+  for (row = 0; row < entry->rows; row++)
+    for (column = 0; column < entry->columns; column++)
+      {
+        gint  x = column * PP_TILE_SIZE;
+        gint  y = row * PP_TILE_SIZE;
+        gint  width = MIN (PP_TILE_SIZE, entry->tiled_width - x);
+        gint  height = MIN (PP_TILE_SIZE, entry->tiled_height - y);
+        gint  tile = row * entry->columns + column;
+        ClutterActor *actor;
+        CoglHandle tex;
+
+        actor = clutter_actor_get_child_at_index (entry->texture, tile);
+        if (x + width <= x0 || x >= x1 || y + height <= y0 || y >= y1)
+          {
+            ClutterActor *empty;
+
+            if (!entry->tiles[tile])
+              continue;
+
+            /* out of view */
+            empty = clutter_texture_new ();
+            clutter_actor_set_position (empty, x, y);
+            clutter_actor_set_size (empty, width, height);
+            clutter_actor_replace_child (entry->texture, actor, empty);
+            entry->tiles[tile] = FALSE;
+            entry->uploaded -= (gsize) width * height;
+            changed = TRUE;
+            continue;
+          }
+
+        if (entry->tiles[tile])
+          continue;
+        if (!pixels->data)
+          {
+            missing = TRUE;
+            continue;
+          }
+
+        tex = texture_cogl (entry, pixels, x, y, width, height);
+        if (tex == COGL_INVALID_HANDLE)
+          continue;
+        texture_tile_set (actor, tex);
+        entry->tiles[tile] = TRUE;
+        entry->uploaded += (gsize) width * height;
+        changed = TRUE;
+      }
+
+  if (pixels->data)
+    pp_pixels_clear (pixels);
+  if (changed)
+    texture_loaded (entry, entry->uploaded, entry->bpp);
+  if (missing && !entry->decode)
+    texture_load (entry);
+}
+
+static void
+texture_decoded (PPDecode *job)
+{
+  PPTexture *entry = job->entry;
+  PPPixels  *pixels = &job->pixels;
+  GError    *error = job->error;
+
+  if (entry)
+    {
+      entry->decode = NULL;
+      if (!pixels->data)
+        {
+          g_warning ("Could not load background %s: %s", entry->file,
+                     error ? error->message : "no pixels");
+          goto out;
+        }
+
+      /* the picture shown so far goes in the same frame */
+      texture_clear (entry);
+      entry->width = job->width;
+      entry->height = job->height;
+      entry->scale = job->scale;
+
+      /* drivers pad an RGB888 texture to 4 bytes a pixel, so an opaque
+       * background only takes less memory as RGB565 */
+      entry->format = COGL_PIXEL_FORMAT_RGBA_8888_PRE;
+      entry->bpp = 4;
+      if (pixels->opaque && pp_rgb565)
+        {
+          entry->format = COGL_PIXEL_FORMAT_RGB_565;
+          entry->bpp = 2;
+        }
+
+      if (pixels->width <= PP_TILE_SIZE && pixels->height <= PP_TILE_SIZE)
+        {
+          CoglHandle    tex;
+          ClutterActor *tile;
+
+          tex = texture_cogl (entry, pixels, 0, 0,
+                              pixels->width, pixels->height);
+          if (tex == COGL_INVALID_HANDLE)
+            {
+              g_warning ("Could not load background %s: no texture",
+                         entry->file);
+              goto out;
+            }
+          tile = clutter_texture_new ();
+          texture_tile_set (tile, tex);
+          clutter_actor_add_child (entry->texture, tile);
+          entry->uploaded = (gsize) pixels->width * pixels->height;
+          texture_loaded (entry, entry->uploaded, entry->bpp);
+        }
+      else
+        {
+          gint row, column;
+
+          entry->pixels = *pixels;
+          pixels->data = NULL;
+          pixels->mapped = NULL;
+
+          entry->tiled_width = entry->pixels.width;
+          entry->tiled_height = entry->pixels.height;
+          entry->columns = (entry->pixels.width + PP_TILE_SIZE - 1) /
+                           PP_TILE_SIZE;
+          entry->rows = (entry->pixels.height + PP_TILE_SIZE - 1) /
+                        PP_TILE_SIZE;
+          entry->tiles = g_malloc0 (entry->columns * entry->rows);
+          for (row = 0; row < entry->rows; row++)
+            for (column = 0; column < entry->columns; column++)
+              {
+                ClutterActor *tile = clutter_texture_new ();
+                gint          x = column * PP_TILE_SIZE;
+                gint          y = row * PP_TILE_SIZE;
+
+                clutter_actor_set_position (tile, x, y);
+                clutter_actor_set_size (tile,
+                    MIN (PP_TILE_SIZE, entry->pixels.width - x),
+                    MIN (PP_TILE_SIZE, entry->pixels.height - y));
+                clutter_actor_add_child (entry->texture, tile);
+              }
+          texture_tiles_update (entry);
+        }
+    }
+
+out:
+  g_clear_error (&error);
+  if (pixels->data)
+    pp_pixels_clear (pixels);
+  g_free (job->file);
+  g_slice_free (PPDecode, job);
+}
 
-  if (!source)
-    return NULL;
+/* runs below the redraw priority, so a frame is drawn between the calls */
+static gboolean
+texture_upload (gpointer data)
+{
+  gint64    start = g_get_monotonic_time ();
+  PPDecode *job;
 
-  clutter_actor_add_child (renderer->stage, source);
-  clutter_actor_hide (source);
+  while ((job = g_queue_pop_head (&texture_uploads)))
+    {
+      texture_decoded (job);
+      if (g_get_monotonic_time () - start > PP_UPLOAD_BUDGET)
+        break;
+    }
 
-  g_hash_table_insert (renderer->bg_cache, (char *) g_strdup (file), source);
+  if (g_queue_is_empty (&texture_uploads))
+    {
+      texture_upload_tag = 0;
+      return FALSE;
+    }
+  return TRUE;
+}
 
-  return clutter_clone_new (source);
+static gboolean
+texture_queue_upload (gpointer data)
+{
+  g_queue_push_tail (&texture_uploads, data);
+  if (!texture_upload_tag)
+    texture_upload_tag = g_idle_add (texture_upload, NULL);
+  return FALSE;
+}
+
+#if !defined (USE_DAX) && defined (HAVE_RSVG)
+static void
+texture_rasterize (PPDecode *job)
+{
+  RsvgHandle        *svg;
+  RsvgDimensionData  dim;
+  PPPixels          *pixels = &job->pixels;
+  cairo_surface_t   *surface;
+  cairo_t           *cr;
+  char              *cache;
+
+  svg = rsvg_handle_new_from_file (job->file, &job->error);
+  if (!svg)
+    return;
+
+  rsvg_handle_get_dimensions (svg, &dim);
+  job->width = dim.width;
+  job->height = dim.height;
+  job->scale = texture_scale (job->modes, TRUE, dim.width, dim.height,
+                              job->stage_width, job->stage_height);
+
+  pixels->width = MAX (1, dim.width * job->scale);
+  pixels->height = MAX (1, dim.height * job->scale);
+  cache = pp_cache_path (job->file, job->modes, pixels->width, pixels->height);
+  if (cache && pp_cache_load (cache, pixels))
+    {
+      g_free (cache);
+      g_object_unref (svg);
+      return;
+    }
+
+  pixels->stride = cairo_format_stride_for_width (CAIRO_FORMAT_ARGB32,
+                                                  pixels->width);
+  pixels->data = g_malloc0 ((gsize) pixels->stride * pixels->height);
+  pixels->opaque = FALSE;
+  surface = cairo_image_surface_create_for_data (pixels->data,
+                                                 CAIRO_FORMAT_ARGB32,
+                                                 pixels->width,
+                                                 pixels->height,
+                                                 pixels->stride);
+  cr = cairo_create (surface);
+  cairo_scale (cr, job->scale, job->scale);
+  rsvg_handle_render_cairo (svg, cr);
+  cairo_destroy (cr);
+  cairo_surface_destroy (surface);
+  g_object_unref (svg);
+
+  if (cache)
+    pp_cache_save (cache, pixels);
+  g_free (cache);
+}
+#endif
+
+static void
+texture_decode (gpointer data,
+                gpointer user_data)
+{
+  PPDecode  *job = data;
+  GdkPixbuf *pixbuf;
+  char      *cache = NULL;
+  gint       width, height;
+
+#if !defined (USE_DAX) && defined (HAVE_RSVG)
+  if (job->svg)
+    {
+      texture_rasterize (job);
+      g_idle_add (texture_queue_upload, job);
+      return;
+    }
+#endif
+
+  job->scale = 1.0;
+  if (gdk_pixbuf_get_file_info (job->file, &job->width, &job->height))
+    {
+      job->scale = texture_scale (job->modes, FALSE, job->width, job->height,
+                                  job->stage_width, job->stage_height);
+      width = MAX (1, job->width * job->scale + 0.5);
+      height = MAX (1, job->height * job->scale + 0.5);
+      cache = pp_cache_path (job->file, job->modes, width, height);
+    }
+
+  if (cache && pp_cache_load (cache, &job->pixels))
+    {
+      g_free (cache);
+      g_idle_add (texture_queue_upload, job);
+      return;
+    }
+
+  if (job->scale < 1.0)
+    pixbuf = gdk_pixbuf_new_from_file_at_scale (job->file, width, height,
+                                                TRUE, &job->error);
+  else
+    pixbuf = gdk_pixbuf_new_from_file (job->file, &job->error);
+
+  if (pixbuf)
+    {
+      pp_pixels_from_pixbuf (&job->pixels, pixbuf);
+      g_object_unref (pixbuf);
+      if (cache)
+        pp_cache_save (cache, &job->pixels);
+    }
+  g_free (cache);
+
+  g_idle_add (texture_queue_upload, job);
+}
+
+static void
+texture_new (PPTexture *entry)
+{
+  entry->texture = clutter_actor_new ();
+  clutter_actor_add_child (entry->renderer->stage, entry->texture);
+  clutter_actor_hide (entry->texture);
+}
+
+/* the picture shown so far stays until the new decode is in */
+static void
+texture_load (PPTexture *entry)
+{
+  PPDecode *job;
+
+  if (!texture_decoder)
+    texture_decoder = g_thread_pool_new (texture_decode, NULL,
+                                         g_get_num_processors (), FALSE,
+                                         NULL);
+
+  if (entry->decode)
+    entry->decode->entry = NULL;
+
+  job = g_slice_new0 (PPDecode);
+  job->entry = entry;
+  job->file = g_strdup (entry->file);
+  job->svg = entry->svg;
+  job->modes = entry->modes;
+  clutter_actor_get_size (entry->renderer->stage,
+                          &job->stage_width, &job->stage_height);
+
+  entry->decode = job;
+  entry->resident = TRUE;
+  g_thread_pool_push (texture_decoder, job, NULL);
+}
+
+/* decodes again if the stage or the slides using it need more pixels */
+static void
+texture_check (PPTexture *entry)
+{
+  float stage_width, stage_height;
+
+  if (!entry->resident || entry->decode || !entry->width)
+    return;
+
+  clutter_actor_get_size (entry->renderer->stage, &stage_width, &stage_height);
+  if (texture_scale (entry->modes, entry->svg, entry->width, entry->height,
+                     stage_width, stage_height) > entry->scale * 1.05)
+    texture_load (entry);
+}
+
+/* after the slide or the stage changed */
+static void
+texture_tiles_view (ClutterRenderer *renderer)
+{
+  GHashTableIter  iter;
+  PPTexture      *entry;
+
+  g_hash_table_iter_init (&iter, renderer->bg_cache);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &entry))
+    texture_tiles_update (entry);
+}
+
+static guint texture_resize_tag = 0;
+
+static gboolean
+texture_resize (gpointer data)
+{
+  ClutterRenderer *renderer = data;
+  GHashTableIter   iter;
+  PPTexture       *entry;
+
+  texture_resize_tag = 0;
+  g_hash_table_iter_init (&iter, renderer->bg_cache);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &entry))
+    texture_check (entry);
+  texture_tiles_view (renderer);
+  return FALSE;
+}
+
+static void
+texture_unload (PPTexture *entry)
+{
+  ClutterRenderer *renderer = entry->renderer;
+
+  texture_clear (entry);
+  if (entry->decode)
+    entry->decode->entry = NULL;
+  entry->decode = NULL;
+  renderer->texture_bytes -= entry->bytes;
+  renderer->texture_saved -= entry->saved;
+  entry->bytes = 0;
+  entry->saved = 0;
+  entry->resident = FALSE;
+  renderer->texture_evictions++;
+}
+
+static void
+texture_evict (ClutterRenderer *renderer)
+{
+  gsize budget = (gsize) pp_texture_budget * 1024 * 1024;
+
+  while (renderer->texture_bytes > budget)
+    {
+      GHashTableIter  iter;
+      PPTexture      *entry, *victim = NULL;
+
+      g_hash_table_iter_init (&iter, renderer->bg_cache);
+      while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &entry))
+        if (entry->resident && entry->wanted != renderer->texture_stamp &&
+            (!victim || entry->shown < victim->shown))
+          victim = entry;
+
+      if (!victim)
+        break; /* the window alone is over budget */
+      texture_unload (victim);
+    }
+}
+
+static void
+texture_window (ClutterRenderer *renderer,
+                gboolean         backwards)
+{
+  guint stamp = ++renderer->texture_stamp;
+  gint  step = backwards ? -1 : 1;
+  gint  i;
+
+  for (i = -1; i <= pp_texture_window; i++)
+    {
+      PinPointPoint *point = pp_slide_nth (pp_slide_no + i * step);
+      PPTexture     *entry;
+
+      if (!point || !point->bg_file ||
+          !(entry = g_hash_table_lookup (renderer->bg_cache, point->bg_file)))
+        continue;
+
+      entry->wanted = stamp;
+      if (i == 0)
+        {
+          entry->shown = stamp;
+          if (entry->resident)
+            renderer->texture_hits++;
+          else
+            renderer->texture_misses++;
+        }
+      else if (!entry->resident)
+        {
+          renderer->texture_prefetches++;
+        }
+
+      if (!entry->resident)
+        texture_load (entry);
+    }
+
+  texture_evict (renderer);
+}
+
+static PPTexture *
+texture_ref (ClutterRenderer *renderer,
+             PinPointPoint   *point)
+{
+  PPTexture *entry;
+
+  entry = g_hash_table_lookup (renderer->bg_cache, point->bg_file);
+  if (entry)
+    {
+      entry->refs++;
+      entry->modes |= 1 << point->bg_scale;
+      texture_check (entry);
+      return entry;
+    }
+
+  entry = g_slice_new0 (PPTexture);
+  entry->refs = 1;
+  entry->renderer = renderer;
+  entry->file = g_strdup (point->bg_file);
+  entry->svg = point->bg_type == PP_BG_SVG;
+  entry->modes = 1 << point->bg_scale;
+  texture_new (entry);
+  if (pp_texture_budget <= 0)
+    texture_load (entry);
+
+  g_hash_table_insert (renderer->bg_cache, entry->file, entry);
+
+  return entry;
+}
+
+static void
+texture_unref (PPTexture *entry)
+{
+  ClutterRenderer *renderer = entry->renderer;
+
+  if (--entry->refs)
+    return;
+
+  /* nothing shows the file any more, stop watching it as well */
+  g_hash_table_remove (renderer->bg_watches, entry->file);
+  g_hash_table_remove (renderer->bg_cache, entry->file);
 }
 
 #if USE_CLUTTER_GST
@@ -1126,7 +1892,7 @@ on_size_changed (ClutterGstPlayer *player,
   PinPointPoint *point;
   ClutterPointData *data;
 
-  point = pp_slidep->data;
+  point = pp_slide_nth (pp_slide_no);
   if (!point)
     return;
 
@@ -1163,8 +1929,9 @@ setup_camera (PinPointRenderer *renderer,
                       NULL);
       data->player = CLUTTER_GST_PLAYER (camera);
 
-      g_signal_connect (camera, "size-change",
-                        G_CALLBACK (on_size_changed), renderer);
+      data->size_change = g_signal_connect (camera, "size-change",
+                                            G_CALLBACK (on_size_changed),
+                                            renderer);
       return TRUE;
     }
 
@@ -1178,8 +1945,9 @@ setup_camera (PinPointRenderer *renderer,
                                            NULL),
                   NULL);
 
-  g_signal_connect (camera, "size-change",
-                    G_CALLBACK (on_size_changed), renderer);
+  data->size_change = g_signal_connect (camera, "size-change",
+                                        G_CALLBACK (on_size_changed),
+                                        renderer);
 
   return TRUE;
 }
@@ -1203,74 +1971,55 @@ setup_player (PinPointRenderer *renderer,
                   "height", 1.0,
                   NULL);
 
-  g_signal_connect (playback, "size-change",
-                    G_CALLBACK (on_size_changed), renderer);
+  data->size_change = g_signal_connect (playback, "size-change",
+                                        G_CALLBACK (on_size_changed),
+                                        renderer);
 
   return TRUE;
 }
 #endif
 
+/* sets data->background, a hidden child of renderer->background */
 static gboolean
-clutter_renderer_make_point (PinPointRenderer *pp_renderer,
-                             PinPointPoint    *point)
+_clutter_make_background (ClutterRenderer *renderer,
+                          PinPointPoint   *point)
 {
-  ClutterRenderer  *renderer  = CLUTTER_RENDERER (pp_renderer);
-  ClutterPointData *data      = point->data;
-  const char       *file      = point->bg;
-        char       *full_path = NULL;
-  ClutterColor color;
+  ClutterPointData *data = point->data;
   gboolean ret = FALSE;
 
-  if (point->bg_type != PP_BG_COLOR && renderer->path && file)
-    {
-      char *dir = g_path_get_dirname (renderer->path);
-      full_path = g_build_filename (dir, file, NULL);
-      g_free (dir);
-
-      file = full_path;
-    }
-
   switch (point->bg_type)
     {
     case PP_BG_COLOR:
-      {
-        ret = clutter_color_from_string (&color, point->bg);
-        if (ret)
-          {
-            data->background = pp_rectangle_new_with_color (&color);
-            clutter_actor_set_size (data->background, 100.0, 100.0);
-          }
-      }
+      data->background = pp_rectangle_new_with_color (point->bg_rgba);
+      clutter_actor_set_size (data->background, 100.0, 100.0);
+      ret = TRUE;
       break;
     case PP_BG_NONE:
       {
         ClutterColor black = {0, 0, 0, 255};
 
-        ret = clutter_color_from_string (&color, point->stage_color);
-        if (ret)
-          {
-            data->background = pp_rectangle_new_with_color (&color);
-            clutter_actor_set_size (data->background, 100.0, 100.0);
-          }
-        else
-          {
-            data->background = pp_rectangle_new_with_color (&black);
-            clutter_actor_set_size (data->background, 100.0, 100.0);
-          }
-     }
+        /* a stage color that does not parse resolves to black as well */
+        ret = point->stage_rgba != NULL;
+        data->background = pp_rectangle_new_with_color (ret ? point->stage_rgba
+                                                            : &black);
+        clutter_actor_set_size (data->background, 100.0, 100.0);
+      }
       break;
     case PP_BG_IMAGE:
-      data->background = _clutter_get_texture (renderer, file);
+      if (!data->texture)
+        data->texture = texture_ref (renderer, point);
+      data->background = clutter_clone_new (data->texture->texture);
       ret = TRUE;
       break;
     case PP_BG_VIDEO:
 #ifdef USE_CLUTTER_GST
-      ret = setup_player (pp_renderer, point, file);
+      ret = setup_player (PINPOINT_RENDERER (renderer), point,
+                          point->bg_file);
 #endif
       break;
     case PP_BG_CAMERA:
 #ifdef USE_CLUTTER_GST
-      ret = setup_camera (pp_renderer, point);
+      ret = setup_camera (PINPOINT_RENDERER (renderer), point);
 #endif
       break;
     case PP_BG_SVG:
@@ -1281,7 +2030,7 @@ clutter_renderer_make_point (PinPointRenderer *pp_renderer,
 
         aa = pp_super_aa_new ();
         pp_super_aa_set_resolution (PP_SUPER_AA (aa), 2, 2);
-        svg = dax_actor_new_from_file (file, &error);
+        svg = dax_actor_new_from_file (point->bg_file, &error);
         mx_offscreen_set_pick_child (MX_OFFSCREEN (aa), TRUE);
         clutter_actor_add_child (aa, svg);
 
@@ -1290,55 +2039,354 @@ clutter_renderer_make_point (PinPointRenderer *pp_renderer,
         if (data->background == NULL)
           {
             g_warning ("Could not open SVG file %s: %s",
-                       file, error->message);
+                       point->bg_file, error->message);
             g_clear_error (&error);
           }
         ret = data->background != NULL;
       }
+#elif defined (HAVE_RSVG)
+      if (!data->texture)
+        data->texture = texture_ref (renderer, point);
+      data->background = clutter_clone_new (data->texture->texture);
+      ret = TRUE;
 #endif
       break;
     default:
       g_assert_not_reached();
     }
 
-  g_free (full_path);
-
   if (data->background)
     {
       clutter_actor_add_child (renderer->background, data->background);
       clutter_actor_set_opacity (data->background, 0);
     }
 
-  clutter_color_from_string (&color, point->text_color);
+  return ret;
+}
+
+/*
+ * Slide actors
+ *
+ * Only the slides within PP_SLIDE_WINDOW of the current one, and the one
+ * still animating away from the stage, have their text and background
+ * actors. slide_window () makes them as the current slide moves and releases
+ * the ones that fell behind, so neither startup nor memory grows with the
+ * number of slides. What stays for every slide is the PPTexture of an image
+ * background, which has its own window, see texture_window ().
+ *
+ * The actors of the slides that are made but not shown are hidden, once
+ * leave_slide () animated them away, so clutter neither allocates, paints
+ * nor picks them. show_slide () shows them again.
+ */
+
+#define PP_SLIDE_WINDOW 2    /* slides on either side of the current one */
+#define PP_LEAVE_TIME   2000 /* ms, the longest animation of leave_slide () */
+
+/* only changed by --benchmark-frames, to compare with every slide made and
+ * on the stage */
+static gint     slide_window_size = PP_SLIDE_WINDOW;
+static gboolean slide_parking = TRUE;
+
+/* an estimate of the height of the text, the resting texts are far off the
+ * stage and this saves laying out the text of every slide up front */
+static float
+slide_rest_height (PinPointPoint *point)
+{
+  float       size = 0.0;
+  gint        lines = 1;
+  const char *p;
+
+  if (point->font_desc)
+    {
+      size = pango_font_description_get_size (point->font_desc) /
+             (float) PANGO_SCALE;
+      if (!pango_font_description_get_size_is_absolute (point->font_desc))
+        size *= 96.0 / 72.0;
+    }
+  for (p = point->text; p && *p; p++)
+    if (*p == '\n')
+      lines++;
+
+  return lines * size * 1.2;
+}
+
+static void
+slide_release_background (ClutterPointData *data)
+{
+#ifdef USE_CLUTTER_GST
+  if (data->player)
+    {
+      g_signal_handler_disconnect (data->player, data->size_change);
+      /* the camera is shared by all the slides using it */
+      if (!CLUTTER_GST_IS_CAMERA (data->player))
+        {
+          clutter_gst_player_set_playing (data->player, FALSE);
+          g_object_unref (data->player);
+        }
+      data->player = NULL;
+    }
+#endif
+  if (data->background)
+    clutter_actor_destroy (data->background);
+  data->background = NULL;
+}
+
+/* the reverse of slide_make (), data->texture is kept */
+static void
+slide_release (ClutterPointData *data)
+{
+  if (data->park_tag)
+    g_source_remove (data->park_tag);
+  data->park_tag = 0;
+  data->leaving = FALSE;
+  slide_release_background (data);
+  if (data->text)
+    clutter_actor_destroy (data->text);
+  data->text = NULL;
+  if (data->json_slide)
+    clutter_actor_destroy (data->json_slide);
+  if (data->script)
+    {
+      g_signal_handlers_disconnect_by_func (data->state, state_completed,
+                                            data);
+      g_object_unref (data->script);
+    }
+  data->json_slide = NULL;
+  data->script = NULL;
+  data->state = NULL;
+  data->background2 = NULL;
+  data->midground = NULL;
+  data->foreground = NULL;
+  data->shading = NULL;
+}
+
+static void
+slide_make (ClutterRenderer *renderer,
+            PinPointPoint   *point)
+{
+  ClutterPointData *data = point->data;
+
+  if (data->text)
+    return;
+
+  _clutter_make_background (renderer, point);
 
   if (point->use_markup)
     {
       data->text = g_object_new (CLUTTER_TYPE_TEXT,
-                                 "font-name",      point->font,
-                                 "text",           point->text,
-                                 "line-alignment", point->text_align,
-                                 "color",          &color,
-                                 "use-markup",     TRUE,
+                                 "font-description", point->font_desc,
+                                 "text",             point->text,
+                                 "line-alignment",   point->text_align,
+                                 "color",            point->text_rgba,
+                                 "use-markup",       TRUE,
                                  NULL);
     }
   else
     {
       data->text = g_object_new (CLUTTER_TYPE_TEXT,
-                                 "font-name",      point->font,
-                                 "text",           point->text,
-                                 "line-alignment", point->text_align,
-                                 "color",          &color,
+                                 "font-description", point->font_desc,
+                                 "text",             point->text,
+                                 "line-alignment",   point->text_align,
+                                 "color",            point->text_rgba,
                                  NULL);
     }
 
   clutter_actor_add_child (renderer->foreground, data->text);
 
-  clutter_actor_set_position (data->text, RESTX, renderer->rest_y);
-  data->rest_y = renderer->rest_y;
-  renderer->rest_y += clutter_actor_get_height (data->text);
+  clutter_actor_set_position (data->text, RESTX, data->rest_y);
   clutter_actor_set_z_position (data->text, RESTDEPTH);
+  if (slide_parking)
+    {
+      clutter_actor_hide (data->text);
+      if (data->background)
+        clutter_actor_hide (data->background);
+    }
+}
 
-  return ret;
+/* hides what a slide that is not shown any more left on the stage, once
+ * leave_slide () animated it away */
+static void
+slide_hide (ClutterPointData *data)
+{
+  if (data->park_tag)
+    g_source_remove (data->park_tag);
+  data->park_tag = 0;
+  data->leaving = FALSE;
+  if (data->text)
+    clutter_actor_hide (data->text);
+  if (data->background)
+    clutter_actor_hide (data->background);
+}
+
+static gboolean
+slide_park (gpointer user_data)
+{
+  ClutterPointData *data = user_data;
+
+  data->park_tag = 0;
+  slide_hide (data);
+  return FALSE;
+}
+
+static void
+slide_window (ClutterRenderer *renderer)
+{
+  PinPointPoint *point;
+  gint           i;
+
+  for (i = 0; (point = pp_slide_nth (i)); i++)
+    {
+      ClutterPointData *data = point->data;
+
+      if (!data)
+        continue;
+      if (ABS (i - pp_slide_no) <= slide_window_size)
+        slide_make (renderer, point);
+      else if (data->text && !data->leaving)
+        slide_release (data);
+    }
+}
+
+/*
+ * Frame benchmark
+ *
+ * --benchmark-frames steps through the whole presentation twice. First the
+ * way pinpoint used to lay it out: every slide made before the pass starts
+ * and each left resting at RESTX, RESTDEPTH with its background at opacity
+ * 0, a slide every PP_BENCH_STEP ms. Then with the window of slides and the
+ * hiding above, only moving on once the slide left last is hidden so that
+ * the stage is the one paging slowly gives. The time clutter spends on each
+ * frame, from the pre paint to the post paint repaint function, is reported
+ * for both passes.
+ */
+
+#define PP_BENCH_STEP 200 /* ms per slide at least */
+
+static gboolean
+bench_frame_start (gpointer data)
+{
+  ClutterRenderer *renderer = data;
+
+  renderer->bench_start = g_get_monotonic_time ();
+  return TRUE;
+}
+
+static gboolean
+bench_frame_end (gpointer data)
+{
+  ClutterRenderer *renderer = data;
+  gint64           elapsed;
+
+  if (!renderer->bench_start)
+    return TRUE;
+
+  elapsed = g_get_monotonic_time () - renderer->bench_start;
+  renderer->bench_start = 0;
+  renderer->bench_frames++;
+  renderer->bench_total += elapsed;
+  renderer->bench_worst = MAX (renderer->bench_worst, elapsed);
+  return TRUE;
+}
+
+static void
+bench_reset (ClutterRenderer *renderer)
+{
+  renderer->bench_frames = 0;
+  renderer->bench_total = 0;
+  renderer->bench_worst = 0;
+  renderer->bench_stepped = g_get_monotonic_time ();
+}
+
+/* polled every PP_BENCH_STEP / 4 ms */
+static gboolean
+bench_step (gpointer data)
+{
+  ClutterRenderer *renderer = data;
+  PinPointPoint   *point;
+  gint             i;
+
+  if (!renderer->bench_stepped)
+    {
+      /* everything made up front, outside of the frames timed */
+      pp_stream_finish ();
+      slide_window (renderer);
+      bench_reset (renderer);
+      return TRUE;
+    }
+
+  if (g_get_monotonic_time () - renderer->bench_stepped <
+      PP_BENCH_STEP * 1000)
+    return TRUE;
+  for (i = 0; slide_parking && (point = pp_slide_nth (i)); i++)
+    if (point->data && ((ClutterPointData *) point->data)->leaving)
+      return TRUE;
+
+  if (pp_slide_nth (pp_slide_no + 1))
+    {
+      next_slide (renderer);
+      renderer->bench_stepped = g_get_monotonic_time ();
+      return TRUE;
+    }
+
+  g_print ("frames: %s, %u slides, %u frames, average %.2fms, "
+           "worst %.2fms\n",
+           renderer->bench_pass ? "pruned" : "all slides on the stage",
+           pp_slides->len, renderer->bench_frames,
+           renderer->bench_frames ? renderer->bench_total / 1000.0 /
+                                    renderer->bench_frames : 0.0,
+           renderer->bench_worst / 1000.0);
+
+  if (renderer->bench_pass++)
+    {
+      clutter_main_quit ();
+      return FALSE;
+    }
+
+  slide_window_size = PP_SLIDE_WINDOW;
+  slide_parking = TRUE;
+  goto_slide (renderer, 0);
+  bench_reset (renderer);
+  return TRUE;
+}
+
+static void
+bench_init (ClutterRenderer *renderer)
+{
+  slide_window_size = G_MAXINT;
+  slide_parking = FALSE;
+
+  clutter_threads_add_repaint_func_full (CLUTTER_REPAINT_FLAGS_PRE_PAINT,
+                                         bench_frame_start, renderer, NULL);
+  clutter_threads_add_repaint_func_full (CLUTTER_REPAINT_FLAGS_POST_PAINT,
+                                         bench_frame_end, renderer, NULL);
+  g_timeout_add (PP_BENCH_STEP / 4, bench_step, renderer);
+}
+
+static gboolean
+clutter_renderer_make_point (PinPointRenderer *pp_renderer,
+                             PinPointPoint    *point)
+{
+  ClutterRenderer  *renderer  = CLUTTER_RENDERER (pp_renderer);
+  ClutterPointData *data      = point->data;
+
+  /* the texture is shared and loaded according to its own window, only the
+   * clone showing it waits for slide_make () */
+  if (point->bg_type == PP_BG_IMAGE)
+    data->texture = texture_ref (renderer, point);
+#if !defined (USE_DAX) && defined (HAVE_RSVG)
+  if (point->bg_type == PP_BG_SVG)
+    data->texture = texture_ref (renderer, point);
+#endif
+
+  if (point->bg_type == PP_BG_IMAGE ||
+      point->bg_type == PP_BG_VIDEO ||
+      point->bg_type == PP_BG_SVG)
+    watch_asset (renderer, point->bg_file);
+
+  data->rest_y = renderer->rest_y;
+  renderer->rest_y += slide_rest_height (point);
+
+  return TRUE;
 }
 
 static void *
@@ -1355,14 +2403,11 @@ clutter_renderer_free_data (PinPointRenderer *renderer,
 {
   ClutterPointData *data = datap;
 
-  if (data->background)
-    clutter_actor_destroy (data->background);
-  if (data->text)
-    clutter_actor_destroy (data->text);
-  if (data->json_slide)
-    clutter_actor_destroy (data->json_slide);
-  if (data->script)
-    g_object_unref (data->script);
+  if (CLUTTER_RENDERER (renderer)->shown == data)
+    CLUTTER_RENDERER (renderer)->shown = NULL;
+  slide_release (data);
+  if (data->texture)
+    texture_unref (data->texture);
   g_slice_free (ClutterPointData, data);
 }
 
@@ -1371,6 +2416,7 @@ static void end_of_presentation (ClutterRenderer *renderer)
   if (pp_rehearse)
     {
       pp_rehearse_done ();
+      renderer->timing_dirty = TRUE;
     }
   pp_rehearse = FALSE;
   if (renderer->autoadvance)
@@ -1533,6 +2579,11 @@ key_pressed (ClutterActor    *actor,
       case CLUTTER_Home:
         start (NULL, NULL, renderer);
         break;
+      case CLUTTER_End:
+        pp_stream_finish ();
+        if (pp_slides)
+          goto_slide (renderer, pp_slides->len - 1);
+        break;
     }
   return TRUE;
 }
@@ -1559,11 +2610,12 @@ mouse_clicked (ClutterActor    *actor,
 static void leave_slide (ClutterRenderer *renderer,
                          gboolean         backwards)
 {
-  PinPointPoint *point = pp_slidep->data;
+  PinPointPoint *point = pp_slide_nth (pp_slide_no);
   ClutterPointData *data = point->data;
 
   point->new_duration += g_timer_elapsed (renderer->timer, NULL) -
                                           renderer->slide_start_time;
+  renderer->timing_dirty = TRUE;
 
   if (!point->transition)
     {
@@ -1617,12 +2669,21 @@ static void leave_slide (ClutterRenderer *renderer,
         }
 #endif
     }
+
+  /* hidden once the leave animation is done, by state_completed () for a
+   * transition, by the timeout otherwise or should that never complete */
+  if (slide_parking)
+    {
+      data->leaving = TRUE;
+      if (data->park_tag)
+        g_source_remove (data->park_tag);
+      data->park_tag = g_timeout_add (PP_LEAVE_TIME, slide_park, data);
+    }
 }
 
 static void state_completed (ClutterState *state, gpointer user_data)
 {
-  PinPointPoint    *point     = user_data;
-  ClutterPointData *data      = point->data;
+  ClutterPointData *data      = user_data;
   const char       *new_state = clutter_state_get_state (state);
 
   if (new_state == g_intern_static_string ("post") ||
@@ -1643,6 +2704,8 @@ static void state_completed (ClutterState *state, gpointer user_data)
                         NULL);
           clutter_actor_set_opacity (data->background, 0);
         }
+      if (data->leaving)
+        slide_hide (data);
     }
 }
 
@@ -1653,10 +2716,10 @@ action_slide (ClutterRenderer *renderer)
   ClutterPointData *data;
   const char       *command = NULL;
 
-  if (!pp_slidep)
+  point = pp_slide_nth (pp_slide_no);
+  if (!point)
     return;
 
-  point = pp_slidep->data;
   data = point->data;
 
   if (data->state)
@@ -1696,7 +2759,7 @@ static void update_commandline_shading (ClutterRenderer *renderer)
   float text_x,    text_y,    text_width,    text_height;
   float shading_x, shading_y, shading_width, shading_height;
 
-  point = pp_slidep->data;
+  point = pp_slide_nth (pp_slide_no);
   clutter_actor_get_size (renderer->commandline, &text_width, &text_height);
   clutter_actor_get_position (renderer->commandline, &text_x, &text_y);
   pp_get_shading_position_size (clutter_actor_get_width (renderer->stage),
@@ -1707,7 +2770,7 @@ static void update_commandline_shading (ClutterRenderer *renderer)
                                 &shading_x, &shading_y,
                                 &shading_width, &shading_height);
 
-  clutter_color_from_string (&color, point->shading_color);
+  color = *point->shading_rgba;
   g_object_set (renderer->commandline_shading,
          "x", shading_x,
          "y", shading_y,
@@ -1726,69 +2789,90 @@ static void update_commandline_shading (ClutterRenderer *renderer)
                      NULL);
 }
 
-static gfloat point_time (ClutterRenderer *renderer,
-                          PinPointPoint   *point)
+/* The speaker screen asks for slide times every frame, so keep the running
+ * totals of the planned and of the rehearsed durations; entry n holds the time
+ * of the slides before slide n. They only need rebuilding when a duration
+ * changes (leaving a slide, rehearsal, reload), flagged with timing_dirty,
+ * or when slides have been added by a presentation still streaming in.
+ */
+static void timing_update (ClutterRenderer *renderer)
 {
-  GList *iter;
-  float time;
-  gboolean after_current = FALSE;
+  gint n = pp_slides ? pp_slides->len : 0;
+  gint i;
+
+  if (!renderer->timing_dirty && renderer->time_planned->len == n + 1)
+    return;
+
+  g_array_set_size (renderer->time_planned, n + 1);
+  g_array_set_size (renderer->time_rehearsed, n + 1);
 
-  for (iter = pp_slides; iter && iter->data != point; iter = iter->next)
+  g_array_index (renderer->time_planned, gdouble, 0) = 0.0;
+  g_array_index (renderer->time_rehearsed, gdouble, 0) = 0.0;
+  for (i = 0; i < n; i++)
     {
-      if (iter == pp_slidep)
-        after_current = TRUE;
+      PinPointPoint *point = g_ptr_array_index (pp_slides, i);
+      gdouble planned, rehearsed;
+
+      planned = point->duration != 0.0 ? point->duration : 2.0;
+      rehearsed = point->new_duration != 0.0 ? point->new_duration : planned;
+
+      g_array_index (renderer->time_planned, gdouble, i + 1) =
+        g_array_index (renderer->time_planned, gdouble, i) + planned;
+      g_array_index (renderer->time_rehearsed, gdouble, i + 1) =
+        g_array_index (renderer->time_rehearsed, gdouble, i) + rehearsed;
     }
 
-  time = point->duration != 0.0 ? point->duration : 2.0;
-  /* if before current point, use new time.. if at or after current point
-     use historic time
+  renderer->timing_dirty = FALSE;
+}
+
+/* time of the slides [start, end) */
+static gfloat range_time (ClutterRenderer *renderer,
+                          gint             start,
+                          gint             end)
+{
+  gint split;
+
+  timing_update (renderer);
+
+  /* up to and including the current slide use the new time, after it use
+     the historic time
    */
-  if (!after_current)
-    if (point->new_duration != 0.0)
-      time = point->new_duration;
-  return time;
+  split = CLAMP (pp_slide_no + 1, start, end);
+  return g_array_index (renderer->time_rehearsed, gdouble, split) -
+         g_array_index (renderer->time_rehearsed, gdouble, start) +
+         g_array_index (renderer->time_planned, gdouble, end) -
+         g_array_index (renderer->time_planned, gdouble, split);
+}
+
+static gfloat point_time (ClutterRenderer *renderer,
+                          gint             slide_no)
+{
+  return range_time (renderer, slide_no, slide_no + 1);
 }
 
 static gfloat total_time (ClutterRenderer *renderer,
-                          GList *start)
+                          gint             start)
 {
-  GList *iter;
-  gfloat total = 0;
-  if (!start)
-    start = pp_slides;
-  for (iter = start; iter; iter = iter->next)
-    {
-      total += point_time (renderer, iter->data);
-    }
-  return total;
+  return range_time (renderer, start, pp_slides->len);
 }
 
 static gfloat slide_rel_duration (ClutterRenderer *renderer,
-                                  GList *slide)
+                                  gint             slide_no)
 {
-  return point_time (renderer, slide->data) / total_time (renderer, pp_slides);
+  return point_time (renderer, slide_no) / total_time (renderer, 0);
 }
 
 static gfloat slide_rel_start (ClutterRenderer *renderer,
-                               GList *slide)
+                               gint             slide_no)
 {
-  GList *iter;
-  float time = 0;
-
-  for (iter = slide ->prev; iter; iter = iter->prev)
-    {
-      time += point_time (renderer, iter->data);
-    }
-
-  time = time / total_time (renderer, pp_slides);
-  return time;
+  return range_time (renderer, 0, slide_no) / total_time (renderer, 0);
 }
 
 static gfloat slide_time (ClutterRenderer *renderer,
-                          GList *slide)
+                          gint             slide_no)
 {
-  float time = point_time (renderer, slide->data) /
-                     total_time (renderer, slide);
+  float time = point_time (renderer, slide_no) /
+                     total_time (renderer, slide_no);
   float remaining_time = renderer->total_seconds -
                            g_timer_elapsed (renderer->timer, NULL);
   time *= remaining_time;
@@ -1800,14 +2884,14 @@ static gboolean update_speaker_screen (ClutterRenderer *renderer)
 {
   PinPointPoint *point;
 
-  if (!pp_slidep)
+  point = pp_slide_nth (pp_slide_no);
+  if (!point)
     return FALSE;
 
-  point = pp_slidep->data;
   static gboolean is_updated = TRUE;
   static float current_slide_time = 0.0;
   static float current_slide_duration = 0.0;
-  static GList *current_slide = NULL;
+  static PinPointPoint *current_slide = NULL;
   float nh, nw;
 
   /* Skip this update since the previous one isn't finished */
@@ -1829,11 +2913,11 @@ static gboolean update_speaker_screen (ClutterRenderer *renderer)
       float warn_time = SLIDE_WARN_TIME;
       float diff = g_timer_elapsed (renderer->timer, NULL) - current_slide_prev_time;
 
-      if (current_slide != pp_slidep)
+      if (current_slide != point)
         {
           current_slide_time = 0;
-          current_slide = pp_slidep;
-          current_slide_duration = slide_time (renderer, pp_slidep);
+          current_slide = point;
+          current_slide_duration = slide_time (renderer, pp_slide_no);
         }
 
       /* if 33% of the slide is longer than the seconds based threshold, use
@@ -1888,10 +2972,6 @@ static gboolean update_speaker_screen (ClutterRenderer *renderer)
 
   { /* should draw rectangles representing progress instead... */
     GString *str = g_string_new ("");
-    int i;
-    GList *iter;
-    for (iter = pp_slides, i=0; iter && iter != pp_slidep;
-         iter = iter->next, i++);
 
     {
       int time;
@@ -1962,9 +3042,9 @@ static gboolean update_speaker_screen (ClutterRenderer *renderer)
        nh - clutter_actor_get_height (renderer->speaker_time_remaining) - 4);
 
     clutter_actor_set_width (renderer->speaker_prog_slide,
-                             nw * slide_rel_duration (renderer, pp_slidep));
+                             nw * slide_rel_duration (renderer, pp_slide_no));
     clutter_actor_set_x (renderer->speaker_prog_slide,
-                         nw * slide_rel_start (renderer, pp_slidep));
+                         nw * slide_rel_start (renderer, pp_slide_no));
 
     clutter_actor_set_x (renderer->speaker_prog_time, nw * elapsed_part);
 
@@ -1975,11 +3055,11 @@ static gboolean update_speaker_screen (ClutterRenderer *renderer)
   }
 
   // if first slide, do not show "previous"
-  if (!pp_slidep->prev) clutter_actor_hide(renderer->speaker_prev);
+  if (!pp_slide_nth (pp_slide_no - 1)) clutter_actor_hide(renderer->speaker_prev);
   else clutter_actor_show(renderer->speaker_prev);
 
   // same for last slide
-  if (!pp_slidep->next) clutter_actor_hide(renderer->speaker_next);
+  if (!pp_slide_nth (pp_slide_no + 1)) clutter_actor_hide(renderer->speaker_next);
   else clutter_actor_show(renderer->speaker_next);
 
 
@@ -1996,8 +3076,8 @@ static gboolean update_speaker_screen (ClutterRenderer *renderer)
   }
 
   {
-    static GList *current_slide = NULL;
-    if (current_slide != pp_slidep)
+    static PinPointPoint *current_slide = NULL;
+    if (current_slide != point)
       {
         cairo_t *cr;
 
@@ -2006,12 +3086,8 @@ static gboolean update_speaker_screen (ClutterRenderer *renderer)
         cairo_renderer_set_cr (renderer->cairo_renderer,
                                cr, clutter_actor_get_width (renderer->speaker_prev),
                                clutter_actor_get_height (renderer->speaker_prev));
-        if (pp_slidep->prev)
-          cairo_renderer_render_page (renderer->cairo_renderer,
-                                      pp_slidep->prev->data);
-        else
-          cairo_renderer_render_page (renderer->cairo_renderer,
-                                      NULL);
+        cairo_renderer_render_page (renderer->cairo_renderer,
+                                    pp_slide_nth (pp_slide_no - 1));
         cairo_renderer_unset_cr (renderer->cairo_renderer);
         cairo_destroy (cr);
 
@@ -2021,7 +3097,7 @@ static gboolean update_speaker_screen (ClutterRenderer *renderer)
                                cr, clutter_actor_get_width (renderer->speaker_current),
                                clutter_actor_get_height (renderer->speaker_current));
         cairo_renderer_render_page (renderer->cairo_renderer,
-                                    pp_slidep->data);
+                                    point);
         cairo_renderer_unset_cr (renderer->cairo_renderer);
         cairo_destroy (cr);
 
@@ -2030,16 +3106,12 @@ static gboolean update_speaker_screen (ClutterRenderer *renderer)
         cairo_renderer_set_cr (renderer->cairo_renderer,
                                cr, clutter_actor_get_width (renderer->speaker_next),
                                clutter_actor_get_height (renderer->speaker_next));
-        if (pp_slidep->next)
-          cairo_renderer_render_page (renderer->cairo_renderer,
-                                      pp_slidep->next->data);
-        else
-          cairo_renderer_render_page (renderer->cairo_renderer,
-                                      NULL);
+        cairo_renderer_render_page (renderer->cairo_renderer,
+                                    pp_slide_nth (pp_slide_no + 1));
         cairo_renderer_unset_cr (renderer->cairo_renderer);
         cairo_destroy (cr);
         /*************/
-        current_slide = pp_slidep;
+        current_slide = point;
     }
   }
 
@@ -2096,19 +3168,29 @@ show_slide (ClutterRenderer *renderer, gboolean backwards)
   ClutterPointData *data;
   ClutterColor      color;
 
-  if (!pp_slidep)
+  point = pp_slide_nth (pp_slide_no);
+  if (!point)
     return;
 
   renderer->slide_start_time = g_timer_elapsed (renderer->timer, NULL);
 
-  point = pp_slidep->data;
+  if (pp_texture_budget > 0)
+    texture_window (renderer, backwards);
+  slide_window (renderer);
+
   data = point->data;
+  renderer->shown = data;
+  if (data->park_tag)
+    g_source_remove (data->park_tag);
+  data->park_tag = 0;
+  data->leaving = FALSE;
+  clutter_actor_show (data->text);
+  if (data->background)
+    clutter_actor_show (data->background);
+  texture_tiles_view (renderer);
 
-  if (point->stage_color)
-    {
-      clutter_color_from_string (&color, point->stage_color);
-      clutter_actor_set_background_color (renderer->stage, &color);
-    }
+  if (point->stage_rgba)
+    clutter_actor_set_background_color (renderer->stage, point->stage_rgba);
 
   if (data->background)
     {
@@ -2179,7 +3261,7 @@ show_slide (ClutterRenderer *renderer, gboolean backwards)
              &shading_x, &shading_y,
              &shading_width, &shading_height);
 
-         clutter_color_from_string (&color, point->shading_color);
+         color = *point->shading_rgba;
 
          pp_actor_animate (data->text,
                             CLUTTER_EASE_OUT_QUINT, 1000,
@@ -2251,8 +3333,9 @@ show_slide (ClutterRenderer *renderer, gboolean backwards)
               clutter_script_get_object (data->script, "actor"));
 
           clutter_actor_add_child (renderer->json_layer, data->json_slide);
+          /* the data can outlive the point across reloads */
           g_signal_connect (data->state, "completed",
-                            G_CALLBACK (state_completed), point);
+                            G_CALLBACK (state_completed), data);
           clutter_state_warp_to_state (data->state, "pre");
 
           if (data->background2) /* parmanently steal background */
@@ -2309,7 +3392,7 @@ show_slide (ClutterRenderer *renderer, gboolean backwards)
          {
            ClutterColor color;
            float shading_x, shading_y, shading_width, shading_height;
-           clutter_color_from_string (&color, point->shading_color);
+           color = *point->shading_rgba;
 
            pp_get_shading_position_size (
                 clutter_actor_get_width (renderer->stage),
@@ -2362,13 +3445,13 @@ show_slide (ClutterRenderer *renderer, gboolean backwards)
   {
    float text_x, text_y, text_width, text_height;
 
-   clutter_color_from_string (&color, point->text_color);
    g_object_set (renderer->commandline,
-                 "font-name", point->font,
-                 "text",      point->command?point->command:"",
-                 "color",     &color,
+                 "font-description", point->font_desc,
+                 "text",             point->command?point->command:"",
+                 "color",            point->text_rgba,
                  NULL);
 
+   color = *point->text_rgba;
    color.alpha *= 0.33;
    g_object_set (renderer->commandline,
                  "selection-color", &color,
@@ -2409,24 +3492,92 @@ stage_resized (ClutterActor    *actor,
 {
   show_slide (renderer, FALSE); /* redisplay the current slide */
   update_speaker_screen (renderer);
+
+  /* once the resizing settles, the backgrounds might need more pixels */
+  if (texture_resize_tag)
+    g_source_remove (texture_resize_tag);
+  texture_resize_tag = g_timeout_add (200, texture_resize, renderer);
 }
 
-static guint reload_tag = 0;
+/* Editors write a file with a burst of CHANGED events ending in a
+ * CHANGES_DONE_HINT, or replace it and a CREATED shows up. Those final events
+ * reload after PP_RELOAD_SETTLE, a burst still going on waits reload_delay,
+ * learnt from how long the bursts so far took and falling back to
+ * PP_RELOAD_DELAY_MAX for monitors never giving hints. */
+#define PP_RELOAD_SETTLE     10   /* ms */
+#define PP_RELOAD_DELAY_MIN  20
+#define PP_RELOAD_DELAY_MAX  200
+
+static guint  reload_tag = 0;
+static guint  reload_delay = PP_RELOAD_DELAY_MAX;
+static gint64 reload_burst = 0; /* start of the current burst, 0 for none */
+
+static void
+reload_done (PinPointRenderer *pp_renderer,
+             gboolean          changed,
+             guint             made,
+             gpointer          data)
+{
+  ClutterRenderer *renderer = CLUTTER_RENDERER (pp_renderer);
+  PinPointPoint   *point;
+  gint64           elapsed;
+  gint             i;
+
+  if (!changed)
+    {
+      g_debug ("reload skipped, %s has the slides shown already",
+               renderer->path);
+      return;
+    }
+
+  /* the reload goes to the first changed slide, the one shown before is
+   * left like when paging if it was kept */
+  for (i = 0; renderer->shown && (point = pp_slide_nth (i)); i++)
+    if (point->data == renderer->shown)
+      {
+        gint current = pp_slide_no;
+
+        if (i != current)
+          {
+            pp_slide_no = i;
+            leave_slide (renderer, FALSE);
+            pp_slide_no = current;
+          }
+        break;
+      }
+
+  renderer->timing_dirty = TRUE;
+  show_slide (renderer, FALSE);
+
+  elapsed = g_get_monotonic_time () - renderer->reload_start;
+  renderer->reload_count++;
+  renderer->reload_time_total += elapsed;
+  g_debug ("reload %u: rebuilt %u of %u slides in %.1fms (average %.1fms)",
+           renderer->reload_count, made, pp_slides->len,
+           elapsed / 1000.0,
+           renderer->reload_time_total / 1000.0 / renderer->reload_count);
+}
 
 static gboolean
 reload (gpointer data)
 {
   ClutterRenderer *renderer = data;
-  char            *text     = NULL;
+  GMappedFile     *mapped;
 
-  if (!g_file_get_contents (renderer->path, &text, NULL, NULL))
+  reload_tag = 0;
+  reload_burst = 0;
+  mapped = g_mapped_file_new (renderer->path, FALSE, NULL);
+  if (!mapped)
     g_error ("failed to load slides from %s\n", renderer->path);
 
-  renderer->rest_y = STARTPOS;
-  pp_parse_slides (PINPOINT_RENDERER (renderer), text);
-  g_free (text);
-  show_slide(renderer, FALSE);
-  reload_tag = 0;
+  /* parsed on a thread while the current slides keep running, the changed
+   * ones are made and swapped in before reload_done (). renderer->rest_y is
+   * not reset, slides that are kept across the reload still rest where they
+   * were put */
+  renderer->reload_start = g_get_monotonic_time ();
+  pp_parse_slides_async (PINPOINT_RENDERER (renderer), mapped,
+                         reload_done, NULL);
+  g_mapped_file_unref (mapped);
   return FALSE;
 }
 
@@ -2437,10 +3588,140 @@ file_changed (GFileMonitor      *monitor,
               GFileMonitorEvent  event_type,
               ClutterRenderer   *renderer)
 {
+  gint64 now = g_get_monotonic_time ();
+  guint  delay;
+
+  switch (event_type)
+    {
+    case G_FILE_MONITOR_EVENT_CHANGED:
+      if (!reload_burst)
+        reload_burst = now;
+      delay = reload_delay;
+      break;
+    case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+    case G_FILE_MONITOR_EVENT_CREATED:
+      if (reload_burst)
+        reload_delay = CLAMP ((now - reload_burst) / 1000 + PP_RELOAD_SETTLE,
+                              PP_RELOAD_DELAY_MIN, PP_RELOAD_DELAY_MAX);
+      reload_burst = 0;
+      delay = PP_RELOAD_SETTLE;
+      break;
+    default:
+      /* deleted (a CREATED follows when the file is being replaced) or
+       * attributes only, nothing to load */
+      return;
+    }
+
   if (reload_tag)
     g_source_remove (reload_tag);
 
-  reload_tag = g_timeout_add (200, reload, renderer);
+  reload_tag = g_timeout_add (delay, reload, renderer);
+}
+
+/*
+ * Watching the backgrounds
+ *
+ * Each image, video and svg background gets a monitor of its own. An image
+ * that changes is decoded again into the texture in bg_cache, asynchronously,
+ * and all the clones of it follow, videos and svgs are made again for the
+ * slides using them. Nothing else is touched.
+ */
+
+static gboolean
+asset_reload (gpointer data)
+{
+  PPAssetWatch    *watch    = data;
+  ClutterRenderer *renderer = watch->renderer;
+  PPTexture       *entry;
+  PinPointPoint   *point;
+  gboolean         current = FALSE;
+  gint             i;
+
+  watch->tag = 0;
+
+  /* the old image stays until the new one is in. One that is not loaded is
+   * read afresh when it is needed, a video or svg of a slide that is not
+   * made when it is made */
+  entry = g_hash_table_lookup (renderer->bg_cache, watch->file);
+  if (entry && entry->resident)
+    texture_load (entry);
+
+  for (i = 0; (point = pp_slide_nth (i)); i++)
+    {
+      ClutterPointData *data = point->data;
+
+      if (!data || !data->text || data->texture ||
+          g_strcmp0 (point->bg_file, watch->file))
+        continue;
+
+      slide_release_background (data);
+      _clutter_make_background (renderer, point);
+      if (data->background && slide_parking)
+        clutter_actor_hide (data->background);
+      current |= i == pp_slide_no;
+    }
+
+  if (current)
+    show_slide (renderer, FALSE);
+
+  g_debug ("background %s changed", watch->file);
+  return FALSE;
+}
+
+static void
+asset_changed (GFileMonitor      *monitor,
+               GFile             *file,
+               GFile             *other_file,
+               GFileMonitorEvent  event_type,
+               PPAssetWatch      *watch)
+{
+  /* only once the new file has been written completely */
+  if (event_type != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT &&
+      event_type != G_FILE_MONITOR_EVENT_CREATED)
+    return;
+
+  if (watch->tag)
+    g_source_remove (watch->tag);
+  watch->tag = g_timeout_add (PP_RELOAD_SETTLE, asset_reload, watch);
+}
+
+static void
+watch_asset (ClutterRenderer *renderer,
+             const char      *file)
+{
+  PPAssetWatch *watch;
+  GFile        *gfile;
+  GFileMonitor *monitor;
+
+  if (!file || g_hash_table_lookup (renderer->bg_watches, file))
+    return;
+
+  gfile = g_file_new_for_path (file);
+  monitor = g_file_monitor_file (gfile, G_FILE_MONITOR_NONE, NULL, NULL);
+  g_object_unref (gfile);
+  if (!monitor)
+    return;
+
+  watch = g_slice_new0 (PPAssetWatch);
+  watch->renderer = renderer;
+  watch->file = g_strdup (file);
+  watch->monitor = monitor;
+  g_signal_connect (monitor, "changed", G_CALLBACK (asset_changed), watch);
+
+  g_hash_table_insert (renderer->bg_watches, watch->file, watch);
+}
+
+static void
+unwatch_asset (gpointer data)
+{
+  PPAssetWatch *watch = data;
+
+  if (watch->tag)
+    g_source_remove (watch->tag);
+  g_file_monitor_cancel (watch->monitor);
+  g_object_unref (watch->monitor);
+  g_free (watch->file);
+  g_slice_free (PPAssetWatch, watch);
 }
 
 static ClutterRenderer clutter_renderer_vtable =